@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_COLLISION_ESTIMATOR_H
+#define TURTLEBOT_FOLLOWER_COLLISION_ESTIMATOR_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+#include "turtlebot_follower/follower_settings.h"
+#include "turtlebot_follower/polar_histogram.h"
+
+namespace turtlebot_follower
+{
+
+/** The time to collision when nothing ahead comes closer. */
+const float kNoCollision = std::numeric_limits<float>::infinity();
+/** Faster changes of depth are another object, in m/s. */
+const float kMaxClosingSpeed = 3.0f;
+/** Slower closing is noise or standing still, in m/s. */
+const float kMinClosingSpeed = 0.05f;
+/** Longer gaps between frames restart the tracks, in s. */
+const double kMaxFrameGap = 0.5;
+
+//* Closing speed and time to collision from consecutive depth frames.
+/**
+ * Tracks the closest depth in the obstacle box and the nearest depth
+ * of every histogram sector ahead of the robot from frame to frame.
+ * The change over the time between the frame stamps is the speed at
+ * which each of them closes in, whether the robot drives towards it or
+ * it walks towards the robot; the time to collision is the shortest
+ * depth over closing speed among them.
+ *
+ * Sectors only count while their nearest point lies laterally within
+ * the box, so people passing by do not make up collisions. A depth
+ * that jumps faster than anything can move belongs to another object
+ * than before and restarts the speed of its sector, as do gaps between
+ * frames longer than a few frame periods. The speeds are low pass
+ * filtered, sensor noise would otherwise swamp them at 30 Hz.
+ */
+class CollisionEstimator
+{
+public:
+  CollisionEstimator() : stamp_(0.0), closing_(0.0f), ttc_(kNoCollision) {}
+
+  /*!
+   * @brief Take the obstacle picture of the next frame.
+   * @param stamp The stamp of the frame, in s.
+   * @param closest The closest depth in the box, kNoDepth or beyond if none.
+   * @param box The obstacle box of the frame.
+   * @param histogram The histogram of the frame.
+   * @param smoothing The time constant of the speed filter, in s.
+   */
+  void update(double stamp, float closest, const ObstacleBox& box,
+              const PolarHistogram& histogram, double smoothing)
+  {
+    // One track per sector, and the last one for the box
+    const size_t tracks = histogram.size() + 1;
+    const double dt = stamp - stamp_;
+    const bool restart = depth_.size() != tracks || dt <= 0.0 || dt > kMaxFrameGap;
+    if (restart)
+    {
+      depth_.assign(tracks, kNoDepth);
+      speed_.assign(tracks, 0.0f);
+    }
+    stamp_ = stamp;
+
+    const float alpha = restart ? 0.0f : (float)(dt / (smoothing + dt));
+    closing_ = 0.0f;
+    ttc_ = kNoCollision;
+    for (size_t i = 0; i < tracks; ++i)
+    {
+      float depth = kNoDepth;
+      if (i + 1 == tracks)
+        depth = closest;
+      else if (histogram.occupied(i))
+      {
+        // Only what lies in the path
+        const float lateral = histogram.nearest(i) * (float)tan(histogram.bearingOf(i));
+        if (lateral > box.min_x && lateral < box.max_x)
+          depth = histogram.nearest(i);
+      }
+      track(i, depth, dt, alpha);
+    }
+  }
+
+  /** The fastest closing speed ahead, in m/s, or 0 if nothing comes closer. */
+  float closing() const { return closing_; }
+  /** The shortest time to collision ahead, in s, or kNoCollision. */
+  float timeToCollision() const { return ttc_; }
+
+private:
+  void track(size_t i, float depth, double dt, float alpha)
+  {
+    const float previous = depth_[i];
+    depth_[i] = depth;
+    if (depth >= kNoDepth || previous >= kNoDepth || alpha == 0.0f)
+    {
+      speed_[i] = 0.0f;
+      return;
+    }
+    const float speed = (float)((previous - depth) / dt);
+    if (fabs(speed) > kMaxClosingSpeed)
+    {
+      speed_[i] = 0.0f;
+      return;
+    }
+    speed_[i] += alpha * (speed - speed_[i]);
+    closing_ = std::max(closing_, speed_[i]);
+    if (speed_[i] > kMinClosingSpeed)
+      ttc_ = std::min(ttc_, depth / speed_[i]);
+  }
+
+  double stamp_; /**< The stamp of the previous frame */
+  std::vector<float> depth_; /**< The depth of every track in the previous frame */
+  std::vector<float> speed_; /**< The filtered closing speed of every track */
+  float closing_;
+  float ttc_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_COLLISION_ESTIMATOR_H
@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_COLOR_BLOBS_H
+#define TURTLEBOT_FOLLOWER_COLOR_BLOBS_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <sensor_msgs/Image.h>
+#include "turtlebot_follower/image_roi.h"
+
+namespace turtlebot_follower
+{
+
+//* A color class, as a box in YUV space.
+struct ColorClass
+{
+  std::string name;
+  uint8_t y_min, y_max;
+  uint8_t u_min, u_max;
+  uint8_t v_min, v_max;
+  uint8_t red, green, blue; /**< How blobs of the class are drawn */
+
+  bool contains(int y, int u, int v) const
+  {
+    return y >= y_min && y <= y_max && u >= u_min && u <= u_max && v >= v_min && v <= v_max;
+  }
+};
+
+//* RGB to color class lookup table.
+/**
+ * The classes are boxes in YUV, where lighting changes mostly move Y,
+ * but the camera delivers RGB; the table is indexed by RGB quantized
+ * to 5 bits per channel and holds the first class whose box contains
+ * the YUV value of the cell center, so a pixel costs one lookup.
+ */
+class ColorLut
+{
+public:
+  enum { kBits = 5, kNone = 0 };
+
+  ColorLut() : table_(1 << (3 * kBits), kNone) {}
+
+  /** Fill the table; class i is stored as i + 1. */
+  void build(const std::vector<ColorClass>& classes)
+  {
+    classes_ = classes;
+    const int cells = 1 << kBits;
+    const int half = 1 << (7 - kBits);
+    for (int r = 0; r < cells; ++r)
+      for (int g = 0; g < cells; ++g)
+        for (int b = 0; b < cells; ++b)
+        {
+          // BT.601 with U and V offset to 128
+          const double rr = (r << (8 - kBits)) + half;
+          const double gg = (g << (8 - kBits)) + half;
+          const double bb = (b << (8 - kBits)) + half;
+          const int y = (int)(0.299 * rr + 0.587 * gg + 0.114 * bb);
+          const int u = (int)(-0.169 * rr - 0.331 * gg + 0.5 * bb + 128.0);
+          const int v = (int)(0.5 * rr - 0.419 * gg - 0.081 * bb + 128.0);
+          uint8_t id = kNone;
+          for (size_t i = 0; i < classes.size() && id == kNone; ++i)
+            if (classes[i].contains(y, u, v))
+              id = i + 1;
+          table_[index(r, g, b)] = id;
+        }
+  }
+
+  /** The class of an 8 bit RGB pixel, or kNone. */
+  uint8_t classify(uint8_t r, uint8_t g, uint8_t b) const
+  {
+    return table_[index(r >> (8 - kBits), g >> (8 - kBits), b >> (8 - kBits))];
+  }
+
+  const std::vector<ColorClass>& classes() const { return classes_; }
+
+private:
+  static int index(int r, int g, int b) { return (r << (2 * kBits)) | (g << kBits) | b; }
+
+  std::vector<uint8_t> table_;
+  std::vector<ColorClass> classes_;
+};
+
+//* A connected region of one color class.
+struct ColorBlob
+{
+  int color; /**< The index of the color class */
+  unsigned int area; /**< In pixels */
+  double x, y; /**< The centroid, in pixels */
+  int left, right, top, bottom; /**< The bounding box, inclusive */
+};
+
+//* Finds the blobs of each color class in an image.
+/**
+ * Classifies the pixels through the lookup table, run length encodes
+ * each row into runs of one class, and merges the runs that touch a
+ * run of the same class in the row above with union-find. The image is
+ * read in place and all buffers are reused between frames.
+ */
+class BlobFinder
+{
+public:
+  BlobFinder() : decimation_(1) {}
+
+  ColorLut& lut() { return lut_; }
+
+  /** Look at every n-th pixel of every n-th row only. */
+  void setDecimation(int decimation) { decimation_ = std::max(decimation, 1); }
+
+  /*!
+   * @brief Find the blobs of an image.
+   * @param image An 8 bit RGB, BGR, RGBA or BGRA image.
+   * @param min_area The smallest blob reported, in full resolution pixels.
+   * @param blobs The blobs, largest first, in full resolution pixels.
+   * @return false if the encoding is not supported.
+   */
+  bool find(const sensor_msgs::Image& image, unsigned int min_area, std::vector<ColorBlob>& blobs)
+  {
+    namespace enc = sensor_msgs::image_encodings;
+    const int channels = byteChannels(image.encoding);
+    if (channels < 3)
+      return false;
+    const bool bgr = image.encoding == enc::BGR8 || image.encoding == enc::BGRA8;
+    const int r_off = bgr ? 2 : 0, b_off = bgr ? 0 : 2;
+    const int n = decimation_;
+    const int width = image.width / n, height = image.height / n;
+
+    // Run length encode every row
+    runs_.clear();
+    row_start_.assign(height + 1, 0);
+    for (int v = 0; v < height; ++v)
+    {
+      row_start_[v] = runs_.size();
+      const uint8_t* row = &image.data[v * n * image.step];
+      int start = 0;
+      uint8_t current = ColorLut::kNone;
+      for (int u = 0; u <= width; ++u)
+      {
+        const uint8_t* px = row + u * n * channels;
+        uint8_t id = u < width ? lut_.classify(px[r_off], px[1], px[b_off]) : (uint8_t)ColorLut::kNone;
+        if (id == current)
+          continue;
+        if (current != ColorLut::kNone)
+          addRun(start, u, v, current);
+        current = id;
+        start = u;
+      }
+    }
+    row_start_[height] = runs_.size();
+
+    // Merge the runs overlapping a run of the same class in the row above
+    for (int v = 1; v < height; ++v)
+    {
+      size_t a = row_start_[v - 1], b = row_start_[v];
+      const size_t a_end = row_start_[v], b_end = row_start_[v + 1];
+      while (a < a_end && b < b_end)
+      {
+        if (runs_[a].start < runs_[b].end && runs_[b].start < runs_[a].end &&
+            runs_[a].color == runs_[b].color)
+          unite(a, b);
+        // Move on from the run that ends first
+        if (runs_[a].end < runs_[b].end)
+          ++a;
+        else
+          ++b;
+      }
+    }
+
+    // Sum up the runs of each region in its root
+    stats_.assign(runs_.size(), ColorBlob());
+    for (size_t i = 0; i < runs_.size(); ++i)
+    {
+      const Run& run = runs_[i];
+      ColorBlob& blob = stats_[root(i)];
+      const unsigned int length = run.end - run.start;
+      if (blob.area == 0)
+      {
+        blob.color = run.color - 1;
+        blob.left = run.start;
+        blob.right = run.end - 1;
+        blob.top = blob.bottom = run.row;
+      }
+      blob.area += length;
+      blob.x += 0.5 * (run.start + run.end - 1) * length;
+      blob.y += (double)run.row * length;
+      blob.left = std::min(blob.left, (int)run.start);
+      blob.right = std::max(blob.right, (int)run.end - 1);
+      blob.top = std::min(blob.top, (int)run.row);
+      blob.bottom = std::max(blob.bottom, (int)run.row);
+    }
+
+    blobs.clear();
+    for (size_t i = 0; i < stats_.size(); ++i)
+    {
+      ColorBlob blob = stats_[i];
+      if (blob.area == 0 || blob.area * n * n < min_area)
+        continue;
+      blob.x = (blob.x / blob.area + 0.5) * n - 0.5;
+      blob.y = (blob.y / blob.area + 0.5) * n - 0.5;
+      blob.area *= n * n;
+      blob.left *= n;
+      blob.top *= n;
+      blob.right = blob.right * n + n - 1;
+      blob.bottom = blob.bottom * n + n - 1;
+      blobs.push_back(blob);
+    }
+    std::sort(blobs.begin(), blobs.end(), larger);
+    return true;
+  }
+
+private:
+  struct Run
+  {
+    uint16_t start, end; /**< Columns, end exclusive */
+    uint16_t row;
+    uint8_t color; /**< The class id in the table */
+    uint32_t parent; /**< The union-find parent run */
+  };
+
+  void addRun(int start, int end, int row, uint8_t color)
+  {
+    Run run = {(uint16_t)start, (uint16_t)end, (uint16_t)row, color, (uint32_t)runs_.size()};
+    runs_.push_back(run);
+  }
+
+  /** The root of a run, halving the path on the way. */
+  uint32_t root(uint32_t i)
+  {
+    while (runs_[i].parent != i)
+    {
+      runs_[i].parent = runs_[runs_[i].parent].parent;
+      i = runs_[i].parent;
+    }
+    return i;
+  }
+
+  void unite(uint32_t a, uint32_t b)
+  {
+    a = root(a);
+    b = root(b);
+    // The older run stays the root
+    if (a < b)
+      runs_[b].parent = a;
+    else if (b < a)
+      runs_[a].parent = b;
+  }
+
+  static bool larger(const ColorBlob& a, const ColorBlob& b) { return a.area > b.area; }
+
+  ColorLut lut_;
+  int decimation_;
+  std::vector<Run> runs_;
+  std::vector<size_t> row_start_; /**< The first run of each row */
+  std::vector<ColorBlob> stats_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_COLOR_BLOBS_H
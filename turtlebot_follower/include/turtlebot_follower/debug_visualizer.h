@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_DEBUG_VISUALIZER_H
+#define TURTLEBOT_FOLLOWER_DEBUG_VISUALIZER_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <ros/ros.h>
+#include <visualization_msgs/MarkerArray.h>
+#include "turtlebot_follower/follower_settings.h"
+
+namespace turtlebot_follower
+{
+
+//* Debug markers of the follower for RViz.
+/**
+ * Collects the debug primitives of the follower (box centroid, tracked
+ * faces, steering bearing and state) and publishes them as one
+ * MarkerArray per cycle, on its own timer and rate. Nothing is built
+ * or published while nobody subscribes: the timer only runs between
+ * the first subscription and the last unsubscription, and the setters
+ * return right away otherwise.
+ *
+ * The static geometry (the obstacle box) goes out on a separate
+ * latched topic, once per configuration epoch.
+ */
+class DebugVisualizer
+{
+public:
+  DebugVisualizer() : active_(false), static_epoch_(0), centroid_valid_(false),
+                      centroid_x_(0.0), centroid_y_(0.0), centroid_z_(0.0),
+                      steer_found_(false), steer_bearing_(0.0), state_(-1)
+  {
+  }
+
+  /*!
+   * @brief Advertise the marker topics.
+   * @param nh The node handle to advertise on.
+   * @param rate The rate of the dynamic markers in Hz.
+   */
+  void init(ros::NodeHandle& nh, double rate)
+  {
+    static_pub_ = nh.advertise<visualization_msgs::MarkerArray>("markers_static", 1, true);
+    pub_ = nh.advertise<visualization_msgs::MarkerArray>("markers", 1,
+        boost::bind(&DebugVisualizer::connectCb, this),
+        boost::bind(&DebugVisualizer::connectCb, this));
+    timer_ = nh.createTimer(ros::Duration(1.0 / rate), &DebugVisualizer::publish, this, false, false);
+  }
+
+  /** Whether anyone looks at the dynamic markers. */
+  bool active() const { return active_; }
+
+  /*!
+   * @brief Publish the static geometry of a configuration, once per epoch.
+   */
+  void setSettings(const FollowerSettings& settings)
+  {
+    if (settings.epoch == static_epoch_)
+      return;
+    static_epoch_ = settings.epoch;
+
+    visualization_msgs::MarkerArrayPtr array(new visualization_msgs::MarkerArray());
+    array->markers.push_back(settings.bbox);
+    static_pub_.publish(array);
+  }
+
+  /** The centroid of the points in the box, in the camera frame (y up). */
+  void setCentroid(bool valid, double x, double y, double z)
+  {
+    if (!active_)
+      return;
+    boost::mutex::scoped_lock lock(mutex_);
+    centroid_valid_ = valid;
+    centroid_x_ = x;
+    centroid_y_ = y;
+    centroid_z_ = z;
+  }
+
+  /** The bearings of the faces in view, positive to the right. */
+  void setFaces(const std::vector<double>& bearings)
+  {
+    if (!active_)
+      return;
+    boost::mutex::scoped_lock lock(mutex_);
+    faces_ = bearings;
+  }
+
+  /** The bearing the obstacle histogram chose, if any. */
+  void setSteering(bool found, double bearing)
+  {
+    if (!active_)
+      return;
+    boost::mutex::scoped_lock lock(mutex_);
+    steer_found_ = found;
+    steer_bearing_ = bearing;
+  }
+
+  void setState(int state, const std::string& name)
+  {
+    if (!active_)
+      return;
+    boost::mutex::scoped_lock lock(mutex_);
+    state_ = state;
+    state_name_ = name;
+  }
+
+private:
+  void connectCb()
+  {
+    bool active = pub_.getNumSubscribers() > 0;
+    if (active == active_)
+      return;
+    active_ = active;
+    if (active)
+      timer_.start();
+    else
+      timer_.stop();
+  }
+
+  void publish(const ros::TimerEvent&)
+  {
+    visualization_msgs::MarkerArrayPtr array(new visualization_msgs::MarkerArray());
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+
+      visualization_msgs::Marker centroid = makeMarker(0, visualization_msgs::Marker::SPHERE);
+      centroid.action = centroid_valid_ ? (int)visualization_msgs::Marker::ADD
+                                        : (int)visualization_msgs::Marker::DELETE;
+      centroid.pose.position.x = centroid_x_;
+      centroid.pose.position.y = -centroid_y_;
+      centroid.pose.position.z = centroid_z_;
+      centroid.scale.x = centroid.scale.y = centroid.scale.z = 0.2;
+      setColor(centroid, 1.0, 0.0, 0.0);
+      array->markers.push_back(centroid);
+
+      visualization_msgs::Marker steering = makeRay(2, steer_bearing_, 1.0);
+      setColor(steering, steer_found_ ? 0.0 : 1.0, steer_found_ ? 1.0 : 0.5, 0.0);
+      array->markers.push_back(steering);
+
+      visualization_msgs::Marker faces = makeMarker(3, visualization_msgs::Marker::LINE_LIST);
+      faces.scale.x = 0.02;
+      setColor(faces, 0.0, 0.5, 1.0);
+      for (size_t i = 0; i < faces_.size(); ++i)
+      {
+        faces.points.push_back(geometry_msgs::Point());
+        faces.points.push_back(rayPoint(faces_[i], 2.0));
+      }
+      if (faces.points.empty())
+        faces.action = visualization_msgs::Marker::DELETE;
+      array->markers.push_back(faces);
+
+      visualization_msgs::Marker state = makeMarker(4, visualization_msgs::Marker::TEXT_VIEW_FACING);
+      state.pose.position.y = -0.5;
+      state.pose.position.z = 1.0;
+      state.scale.z = 0.15;
+      state.text = state_name_;
+      setColor(state, 1.0, 1.0, 1.0);
+      array->markers.push_back(state);
+    }
+    pub_.publish(array);
+  }
+
+  static visualization_msgs::Marker makeMarker(int id, int type)
+  {
+    visualization_msgs::Marker marker;
+    marker.header.frame_id = "/camera_rgb_optical_frame";
+    marker.header.stamp = ros::Time();
+    marker.ns = "my_namespace";
+    marker.id = id;
+    marker.type = type;
+    marker.action = visualization_msgs::Marker::ADD;
+    marker.pose.orientation.w = 1.0;
+    return marker;
+  }
+
+  /** A point along a bearing in the optical frame (x right, z forward). */
+  static geometry_msgs::Point rayPoint(double bearing, double length)
+  {
+    geometry_msgs::Point p;
+    p.x = length * sin(bearing);
+    p.z = length * cos(bearing);
+    return p;
+  }
+
+  static visualization_msgs::Marker makeRay(int id, double bearing, double length)
+  {
+    visualization_msgs::Marker ray = makeMarker(id, visualization_msgs::Marker::ARROW);
+    ray.points.push_back(geometry_msgs::Point());
+    ray.points.push_back(rayPoint(bearing, length));
+    ray.scale.x = 0.03;
+    ray.scale.y = 0.06;
+    ray.scale.z = 0.1;
+    return ray;
+  }
+
+  static void setColor(visualization_msgs::Marker& marker, float r, float g, float b)
+  {
+    marker.color.a = 1.0;
+    marker.color.r = r;
+    marker.color.g = g;
+    marker.color.b = b;
+  }
+
+  ros::Publisher pub_;
+  ros::Publisher static_pub_;
+  ros::Timer timer_;
+  boost::atomic<bool> active_;
+  uint64_t static_epoch_;
+
+  boost::mutex mutex_;
+  bool centroid_valid_;
+  double centroid_x_, centroid_y_, centroid_z_;
+  std::vector<double> faces_;
+  bool steer_found_;
+  double steer_bearing_;
+  int state_;
+  std::string state_name_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_DEBUG_VISUALIZER_H
@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_DEPTH_DENOISER_H
+#define TURTLEBOT_FOLLOWER_DEPTH_DENOISER_H
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace turtlebot_follower
+{
+
+//* Spatial and temporal median filter for the decimated depth grid.
+/**
+ * Kinect speckle and flying pixels at depth edges show up as isolated
+ * near samples that flicker from frame to frame. The denoiser samples
+ * the obstacle rows of a depth image on the grid the obstacle pass
+ * uses, takes the per-sample median of the last three frames and then
+ * the 3x3 median of the result.
+ *
+ * Samples are kept in millimeters as 16 bit integers whatever the
+ * image type, clamped below kFar; missing depth counts as kFar so
+ * holes never add obstacle points. All buffers are reused across
+ * frames and only reallocated when the grid changes size. With SSE2
+ * eight samples are filtered per instruction.
+ */
+class DepthDenoiser
+{
+public:
+  enum
+  {
+    kFar = 0x7fff /**< Missing or out of range depth, in millimeters */
+  };
+
+  DepthDenoiser() : width_(0), height_(0), head_(0), frames_(0) {}
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  /** Forget the previous frames. */
+  void reset() { frames_ = 0; }
+
+  /*!
+   * @brief Sample the next frame onto the grid.
+   * @param data The first image row to sample.
+   * @param row_pitch The distance between sampled rows, in elements.
+   * @param pixel_pitch The distance between sampled pixels, in elements.
+   * @param width The number of samples per row.
+   * @param height The number of sampled rows.
+   */
+  template<typename T>
+  void load(const T* data, int row_pitch, int pixel_pitch, int width, int height)
+  {
+    if (width != width_ || height != height_)
+      resize(width, height);
+    head_ = (head_ + 1) % 3;
+    uint16_t* out = &history_[head_][0];
+    for (int v = 0; v < height; ++v, data += row_pitch)
+      for (int u = 0; u < width; ++u)
+        *out++ = toMillimeters(data[u * pixel_pitch]);
+    frames_ = std::min(frames_ + 1, 3);
+  }
+
+  /*!
+   * @brief Filter the latest frame.
+   * @param temporal Whether to take the median with the previous two
+   *                 frames first; needs three frames of history.
+   */
+  void filter(bool temporal)
+  {
+    const int size = width_ * height_;
+    const uint16_t* current = &history_[head_][0];
+    if (temporal && frames_ == 3)
+    {
+      const uint16_t* a = &history_[0][0];
+      const uint16_t* b = &history_[1][0];
+      const uint16_t* c = &history_[2][0];
+      uint16_t* out = &temporal_[0];
+      int i = 0;
+#if defined(__SSE2__)
+      for (; i + 8 <= size; i += 8)
+        store(out + i, median3(load8(a + i), load8(b + i), load8(c + i)));
+#endif
+      for (; i < size; ++i)
+        out[i] = median3(a[i], b[i], c[i]);
+      current = out;
+    }
+    pad(current);
+
+    const int pitch = width_ + 2;
+    for (int v = 0; v < height_; ++v)
+    {
+      const uint16_t* above = &padded_[v * pitch];
+      const uint16_t* row = above + pitch;
+      const uint16_t* below = row + pitch;
+      uint16_t* out = &output_[v * width_];
+      int u = 0;
+#if defined(__SSE2__)
+      for (; u + 8 <= width_; u += 8)
+      {
+        __m128i p[9] = {
+          load8(above + u), load8(above + u + 1), load8(above + u + 2),
+          load8(row + u), load8(row + u + 1), load8(row + u + 2),
+          load8(below + u), load8(below + u + 1), load8(below + u + 2)};
+        store(out + u, median9(p));
+      }
+#endif
+      for (; u < width_; ++u)
+      {
+        uint16_t p[9] = {
+          above[u], above[u + 1], above[u + 2],
+          row[u], row[u + 1], row[u + 2],
+          below[u], below[u + 1], below[u + 2]};
+        out[u] = median9(p);
+      }
+    }
+  }
+
+  /** A row of the filtered grid, in millimeters. */
+  const uint16_t* row(int v) const { return &output_[v * width_]; }
+
+private:
+  static uint16_t toMillimeters(uint16_t depth)
+  {
+    return depth == 0 || depth > kFar ? (uint16_t)kFar : depth;
+  }
+
+  static uint16_t toMillimeters(float depth)
+  {
+    // NaN fails the comparison
+    return depth > 0.0f && depth < kFar / 1000.0f ? (uint16_t)(depth * 1000.0f + 0.5f) : (uint16_t)kFar;
+  }
+
+  void resize(int width, int height)
+  {
+    width_ = width;
+    height_ = height;
+    for (int i = 0; i < 3; ++i)
+      history_[i].assign(width * height, kFar);
+    temporal_.assign(width * height, kFar);
+    padded_.assign((width + 2) * (height + 2), kFar);
+    output_.assign(width * height, kFar);
+    frames_ = 0;
+  }
+
+  /** Copy a grid into the padded buffer, replicating its edges. */
+  void pad(const uint16_t* grid)
+  {
+    const int pitch = width_ + 2;
+    for (int v = 0; v < height_; ++v)
+    {
+      uint16_t* row = &padded_[(v + 1) * pitch];
+      std::copy(grid + v * width_, grid + (v + 1) * width_, row + 1);
+      row[0] = row[1];
+      row[width_ + 1] = row[width_];
+    }
+    std::copy(&padded_[pitch], &padded_[2 * pitch], &padded_[0]);
+    std::copy(&padded_[height_ * pitch], &padded_[(height_ + 1) * pitch], &padded_[(height_ + 1) * pitch]);
+  }
+
+  // Samples stay below 0x8000, so signed 16 bit min/max order them too
+  static uint16_t vmin(uint16_t a, uint16_t b) { return std::min(a, b); }
+  static uint16_t vmax(uint16_t a, uint16_t b) { return std::max(a, b); }
+#if defined(__SSE2__)
+  static __m128i vmin(__m128i a, __m128i b) { return _mm_min_epi16(a, b); }
+  static __m128i vmax(__m128i a, __m128i b) { return _mm_max_epi16(a, b); }
+  static __m128i load8(const uint16_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+  static void store(uint16_t* p, __m128i v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+#endif
+
+  template<typename V>
+  static void sort2(V& a, V& b)
+  {
+    V lo = vmin(a, b);
+    b = vmax(a, b);
+    a = lo;
+  }
+
+  template<typename V>
+  static V median3(V a, V b, V c)
+  {
+    return vmax(vmin(a, b), vmin(vmax(a, b), c));
+  }
+
+  /** The median of nine with 19 compare-exchanges (Paeth). */
+  template<typename V>
+  static V median9(V* p)
+  {
+    sort2(p[1], p[2]); sort2(p[4], p[5]); sort2(p[7], p[8]);
+    sort2(p[0], p[1]); sort2(p[3], p[4]); sort2(p[6], p[7]);
+    sort2(p[1], p[2]); sort2(p[4], p[5]); sort2(p[7], p[8]);
+    sort2(p[0], p[3]); sort2(p[5], p[8]); sort2(p[4], p[7]);
+    sort2(p[3], p[6]); sort2(p[1], p[4]); sort2(p[2], p[5]);
+    sort2(p[4], p[7]); sort2(p[4], p[2]); sort2(p[6], p[4]);
+    sort2(p[4], p[2]);
+    return p[4];
+  }
+
+  int width_;
+  int height_;
+  std::vector<uint16_t> history_[3]; /**< The last three sampled frames */
+  int head_; /**< The latest frame in the history */
+  int frames_; /**< The number of frames in the history */
+  std::vector<uint16_t> temporal_; /**< The temporal median */
+  std::vector<uint16_t> padded_; /**< The spatial filter input with one sample of border */
+  std::vector<uint16_t> output_; /**< The filtered grid */
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_DEPTH_DENOISER_H
@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_DEPTH_PIPELINE_H
+#define TURTLEBOT_FOLLOWER_DEPTH_PIPELINE_H
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <sensor_msgs/CompressedImage.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/LaserScan.h>
+#include <sensor_msgs/PointCloud2.h>
+#include <diagnostic_msgs/DiagnosticStatus.h>
+#include "turtlebot_follower/collision_estimator.h"
+#include "turtlebot_follower/follower_settings.h"
+#include "turtlebot_follower/obstacle_reducer.h"
+#include "turtlebot_follower/polar_histogram.h"
+#include "turtlebot_follower/processing_budget.h"
+#include "turtlebot_follower/rvl_codec.h"
+
+namespace turtlebot_follower
+{
+
+/** Where a depth camera is and where its data goes. */
+struct DepthCamera
+{
+  DepthCamera() : points(false), rvl(false), x(0.0), y(0.0), yaw(0.0), scan_range_min(0.45), scan_range_max(4.0) {}
+
+  std::string name; /**< The name for diagnostics */
+  std::string topic; /**< The depth image or point cloud topic */
+  bool points; /**< Whether the topic carries organized point clouds instead of depth images */
+  bool rvl; /**< Whether the topic carries RVL compressed depth images */
+  std::string scan_topic; /**< The private topic of its laser scan */
+  std::string scan_frame_id; /**< The frame of its laser scan */
+  std::string closing_topic; /**< The private topic of its closing speed */
+  std::string ttc_topic; /**< The private topic of its time to collision */
+  double x; /**< The mounting position on the base, forward of its center */
+  double y; /**< The mounting position on the base, left of its center */
+  double yaw; /**< The mounting yaw on the base, 0 looking forward, pi backwards */
+  double scan_range_min; /**< The minimum valid range of the laser scan */
+  double scan_range_max; /**< The maximum valid range of the laser scan */
+
+  /** Whether the camera looks in the driving direction rather than behind. */
+  bool forward() const { return cos(yaw) >= 0.0; }
+};
+
+/** The obstacle picture of the latest frame of one depth camera. */
+struct DepthObstacles
+{
+  DepthObstacles() : processed(false), stamp(0.0), n(0), area(0.0f), threshold(0.0f),
+                     x(0.0f), y(0.0f), z(0.0f), closing(0.0f), ttc(kNoCollision) {}
+
+  bool processed; /**< Whether any frame has been processed yet */
+  double stamp; /**< The stamp of the latest frame reduced or skipped by the budget; undecodable ones do not count */
+  unsigned int n; /**< The number of samples in the box */
+  float area; /**< Their frontal area, in m^2 */
+  float threshold; /**< The frontal area making an obstacle, in m^2 */
+  float x, y; /**< The sums of their x and y positions */
+  float z; /**< The closest depth */
+  float closing; /**< The fastest closing speed ahead, in m/s */
+  float ttc; /**< The shortest time to collision ahead, in s, or kNoCollision */
+  PolarHistogram histogram; /**< Obstacle density per bearing sector */
+
+  bool blocked() const { return processed && area > threshold; }
+};
+
+//* The obstacle pass of one depth camera.
+/**
+ * Reduces every depth image of a camera into the obstacle box, the
+ * polar histogram and optionally a laser scan, and keeps the result
+ * of the latest frame for the controller to merge. Each pipeline has
+ * its own callback queue and spinner thread, so cameras are processed
+ * in parallel and a slow camera only delays its own results; the
+ * ray table and the processing budget follow the resolution and cost
+ * of this camera alone.
+ *
+ * Cameras whose driver only provides organized point clouds are read
+ * in place through the offsets of their x, y and z fields, with the
+ * same box, histogram and scan reduction as depth images.
+ *
+ * Depth compressed by the RVL encoder nodelet, for a follower running
+ * off the robot, is decoded into a buffer kept across frames; frames
+ * the budget skips are not decoded at all.
+ *
+ * Depth images can be median filtered in space and time before the
+ * obstacle pass, so that sensor noise does not make up obstacles.
+ *
+ * The obstacle box of each frame reaches as far as the robot needs to
+ * stop from the faster of the commanded and the measured velocity.
+ *
+ * Consecutive frames also give how fast the obstacles ahead close in
+ * and the time to collision, which are published for every frame.
+ *
+ * The controller can cap the frame rate, or drop the subscription
+ * altogether, while it needs fewer obstacle decisions.
+ */
+class DepthPipeline
+{
+public:
+  /*!
+   * @brief Set up the pipeline.
+   * @param camera The camera.
+   * @param settings The configuration, only accessed through
+   *                 boost::atomic_load and never null once started.
+   */
+  DepthPipeline(const DepthCamera& camera, const FollowerSettingsConstPtr& settings);
+  ~DepthPipeline();
+
+  /*!
+   * @brief Subscribe and start the spinner.
+   * @param nh The node handle to subscribe the depth topic on.
+   * @param private_nh The node handle to advertise the scan on.
+   */
+  void start(const ros::NodeHandle& nh, const ros::NodeHandle& private_nh);
+
+  const DepthCamera& camera() const { return camera_; }
+
+  /** A copy of the obstacle picture of the latest frame. */
+  DepthObstacles obstacles() const;
+
+  /** Fill in the state of the processing budget. */
+  void diagnostics(diagnostic_msgs::DiagnosticStatus& status) const;
+
+  /** The velocity last sent to the base, for the look-ahead of the next frames. */
+  void setCommand(double linear, double angular);
+
+  /** The velocity the base reports, for the look-ahead of the next frames. */
+  void setOdometry(double linear, double angular);
+
+  /** Process at most rate frames per second, or every frame for 0. */
+  void setRate(double rate);
+
+  /** Subscribe to the depth topic again, or drop the subscription so the driver can idle. */
+  void setActive(bool active);
+
+private:
+  friend class DepthPipelineTest;
+
+  void subscribe();
+  void depthCb(const sensor_msgs::ImageConstPtr& depth_msg);
+  void cloudCb(const sensor_msgs::PointCloud2ConstPtr& cloud);
+  void rvlCb(const sensor_msgs::CompressedImageConstPtr& rvl_msg);
+  bool beginFrame(const std_msgs::Header& header, uint32_t width, uint32_t height,
+                  const FollowerSettings& settings);
+  void finishFrame(const BoxStats& box, const FollowerSettings& settings,
+                   const sensor_msgs::LaserScanPtr& scan, const ros::WallTime& start);
+  sensor_msgs::LaserScanPtr makeScan(const std_msgs::Header& header, uint32_t width);
+
+  /** The pixel stride of the current quality level; only the spinner thread changes it. */
+  int stride() const { return budget_.stride(); }
+
+  DepthCamera camera_;
+  const FollowerSettingsConstPtr& settings_;
+
+  ros::CallbackQueue queue_; /**< Only holds the depth images of this camera */
+  ros::NodeHandle queue_nh_; /**< Subscribes on queue_ */
+  boost::scoped_ptr<ros::AsyncSpinner> spinner_;
+  ros::Subscriber sub_;
+  ros::Publisher scanpub_;
+  ros::Publisher closingpub_;
+  ros::Publisher ttcpub_;
+
+  ObstacleReducer reducer_; /**< Only touched by the spinner thread */
+  CollisionEstimator collision_; /**< Only touched by the spinner thread */
+  RvlDecoder rvl_; /**< Only touched by the spinner thread */
+  double frame_stamp_; /**< The stamp of the frame being reduced, only touched by the spinner thread */
+
+  // Shared with the diagnostics and the controller
+  mutable boost::mutex mutex_;
+  ProcessingBudget budget_; /**< Quality level of the depth callback */
+  uint32_t last_seq_; /**< Sequence number of the last depth image */
+  unsigned int dropped_frames_; /**< Depth images lost before reaching the callback */
+  DepthObstacles obstacles_; /**< The result of the latest frame */
+  double command_linear_, command_angular_; /**< The velocity last sent to the base */
+  double odom_linear_, odom_angular_; /**< The velocity the base reports */
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_DEPTH_PIPELINE_H
@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_DEPTH_PYRAMID_H
+#define TURTLEBOT_FOLLOWER_DEPTH_PYRAMID_H
+
+#include <algorithm>
+#include <stdint.h>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace turtlebot_follower
+{
+
+//* Minimum depth pyramid of a depth image window.
+/**
+ * Level 0 holds the depth of every pixel in millimeters; every level
+ * above holds the minimum of 2x2 tiles of the level below, so a
+ * sample at level k covers 2^k x 2^k pixels. Region queries start at
+ * the top and only descend into the tiles that straddle the region
+ * edge and could still hold something closer, so asking whether a
+ * clear region holds anything near touches a few hundred samples
+ * instead of every pixel.
+ *
+ * Like the DepthDenoiser, depth stays below kFar so that signed 16 bit
+ * SSE2 min orders it; missing depth counts as kFar. The levels are
+ * reused across frames and only reallocated when the window changes
+ * size.
+ */
+class DepthPyramid
+{
+public:
+  enum
+  {
+    kFar = 0x7fff /**< Missing or out of range depth, in millimeters */
+  };
+
+  DepthPyramid() : width_(0), height_(0) {}
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  int levels() const { return min_.size(); }
+
+  /*!
+   * @brief Build the pyramid of a depth image window.
+   * @param data The first pixel of the window.
+   * @param row_step The distance between image rows, in elements.
+   * @param width The width of the window.
+   * @param height The height of the window.
+   */
+  template<typename T>
+  void build(const T* data, int row_step, int width, int height)
+  {
+    if (width != width_ || height != height_)
+      resize(width, height);
+    if (width == 0 || height == 0)
+      return;
+    uint16_t* out = &min_[0][0];
+    for (int v = 0; v < height; ++v, data += row_step, out += width)
+      convertRow(data, width, out);
+    for (size_t k = 1; k < min_.size(); ++k)
+      reduce(k);
+  }
+
+  /** The closest depth of a sample at a level, in millimeters. */
+  int minAt(int level, int x, int y) const { return min_[level][y * level_width_[level] + x]; }
+
+  /** Whether any pixel of [u0, u1) x [v0, v1) is closer than depth millimeters. */
+  bool anyCloser(int u0, int v0, int u1, int v1, int depth) const
+  {
+    Region r = clip(u0, v0, u1, v1);
+    return !r.empty() && search(top(), 0, 0, r, depth) < depth;
+  }
+
+private:
+  struct Region
+  {
+    int u0, v0, u1, v1;
+    bool empty() const { return u0 >= u1 || v0 >= v1; }
+  };
+
+  Region clip(int u0, int v0, int u1, int v1) const
+  {
+    Region r = {std::max(u0, 0), std::max(v0, 0), std::min(u1, width_), std::min(v1, height_)};
+    return r;
+  }
+
+  int top() const { return min_.size() - 1; }
+
+  /*!
+   * @brief Look for depth closer than bound in the region within a
+   * sample, coarse to fine, stopping at the first found.
+   * @param bound The depth to beat; samples that cannot are skipped.
+   * @return A closer depth of the region, or bound if there is none.
+   */
+  int search(int level, int x, int y, const Region& r, int bound) const
+  {
+    const int size = 1 << level;
+    const int u0 = x * size, v0 = y * size;
+    const int u1 = std::min(u0 + size, width_), v1 = std::min(v0 + size, height_);
+    if (u1 <= r.u0 || u0 >= r.u1 || v1 <= r.v0 || v0 >= r.v1)
+      return bound;
+    const int value = minAt(level, x, y);
+    if (value >= bound)
+      return bound;
+    if (level == 0 || (u0 >= r.u0 && u1 <= r.u1 && v0 >= r.v0 && v1 <= r.v1))
+      return value;
+
+    const int below_width = level_width_[level - 1], below_height = level_height_[level - 1];
+    for (int cy = 2 * y; cy < std::min(2 * y + 2, below_height); ++cy)
+      for (int cx = 2 * x; cx < std::min(2 * x + 2, below_width); ++cx)
+      {
+        int found = search(level - 1, cx, cy, r, bound);
+        if (found < bound)
+          return found;
+      }
+    return bound;
+  }
+
+  void resize(int width, int height)
+  {
+    width_ = width;
+    height_ = height;
+    min_.clear();
+    level_width_.clear();
+    level_height_.clear();
+    int w = width, h = height;
+    while (true)
+    {
+      min_.push_back(std::vector<uint16_t>(w * h, kFar));
+      level_width_.push_back(w);
+      level_height_.push_back(h);
+      if (w <= 1 && h <= 1)
+        break;
+      w = (w + 1) / 2;
+      h = (h + 1) / 2;
+    }
+  }
+
+  static void convertRow(const uint16_t* row, int width, uint16_t* out)
+  {
+    int u = 0;
+#if defined(__SSE2__)
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    const __m128i zero = _mm_setzero_si128();
+    // Unsigned compare against kFar through the sign bit
+    const __m128i limit = _mm_set1_epi16((short)(kFar ^ 0x8000));
+    const __m128i far = _mm_set1_epi16(kFar);
+    for (; u + 8 <= width; u += 8)
+    {
+      __m128i depth = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + u));
+      __m128i missing = _mm_or_si128(_mm_cmpeq_epi16(depth, zero),
+                                     _mm_cmpgt_epi16(_mm_xor_si128(depth, bias), limit));
+      depth = _mm_or_si128(_mm_and_si128(missing, far), _mm_andnot_si128(missing, depth));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + u), depth);
+    }
+#endif
+    for (; u < width; ++u)
+      out[u] = row[u] == 0 || row[u] > kFar ? (uint16_t)kFar : row[u];
+  }
+
+  static void convertRow(const float* row, int width, uint16_t* out)
+  {
+    // NaN fails the comparison
+    for (int u = 0; u < width; ++u)
+      out[u] = row[u] > 0.0f && row[u] < kFar / 1000.0f ? (uint16_t)(row[u] * 1000.0f + 0.5f) : (uint16_t)kFar;
+  }
+
+  /** Fill a level from the level below. */
+  void reduce(int level)
+  {
+    const std::vector<uint16_t>& below = min_[level - 1];
+    std::vector<uint16_t>& out = min_[level];
+    const int below_width = level_width_[level - 1], below_height = level_height_[level - 1];
+    const int w = level_width_[level], h = level_height_[level];
+    for (int y = 0; y < h; ++y)
+    {
+      const uint16_t* a = &below[2 * y * below_width];
+      const uint16_t* b = 2 * y + 1 < below_height ? a + below_width : a;
+      uint16_t* o = &out[y * w];
+      int x = 0;
+#if defined(__SSE2__)
+      const __m128i low = _mm_set1_epi32(0xffff);
+      for (; 2 * x + 16 <= below_width; x += 8)
+      {
+        __m128i p = load8(a + 2 * x), q = load8(a + 2 * x + 8);
+        __m128i r = load8(b + 2 * x), s = load8(b + 2 * x + 8);
+        __m128i first = _mm_min_epi16(p, r);
+        __m128i second = _mm_min_epi16(q, s);
+        // Combine the neighbours of each pair into the low half of its 32 bit lane
+        first = _mm_min_epi16(first, _mm_srli_epi32(first, 16));
+        second = _mm_min_epi16(second, _mm_srli_epi32(second, 16));
+        // Depth stays below 0x8000, so packing does not saturate
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + x),
+                         _mm_packs_epi32(_mm_and_si128(first, low), _mm_and_si128(second, low)));
+      }
+#endif
+      for (; x < w; ++x)
+      {
+        const int x0 = 2 * x, x1 = std::min(2 * x + 1, below_width - 1);
+        o[x] = std::min(std::min(a[x0], a[x1]), std::min(b[x0], b[x1]));
+      }
+    }
+  }
+
+#if defined(__SSE2__)
+  static __m128i load8(const uint16_t* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+#endif
+
+  int width_, height_;
+  std::vector<std::vector<uint16_t> > min_; /**< The closest depth per level; level 0 is the depth itself */
+  std::vector<int> level_width_;
+  std::vector<int> level_height_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_DEPTH_PYRAMID_H
@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_EVENT_LOG_H
+#define TURTLEBOT_FOLLOWER_EVENT_LOG_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <boost/atomic.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace turtlebot_follower
+{
+
+/** What an event log record is about. */
+enum EventId
+{
+  EVENT_STATE = 1, /**< arg: the new state, value 0: the previous state */
+  EVENT_FACE = 2, /**< arg: faces seen (0 when lost), values: x, width of the first */
+  EVENT_OBSTACLE = 3, /**< arg: blocked, values: area and threshold in cm^2, steering bearing */
+  EVENT_ENGAGE = 4, /**< A person was greeted */
+  EVENT_STALE = 5, /**< arg: the watchdog input, value 0: its age */
+  EVENT_RESUME = 6, /**< The depth input is back */
+  EVENT_KEY = 7, /**< arg: the key code */
+  EVENT_DROPPED = 8, /**< arg: records lost to full rings since the last flush */
+  EVENT_MARKER = 9, /**< arg: the marker blob area (0 when lost), value 0: its x */
+  EVENT_PROFILE = 10 /**< arg: inputs active, values: depth and detector rate (0 for all frames) */
+};
+
+/** The name of an event, for the decoder. */
+inline const char* eventName(int id)
+{
+  switch (id)
+  {
+    case EVENT_STATE: return "state";
+    case EVENT_FACE: return "face";
+    case EVENT_OBSTACLE: return "obstacle";
+    case EVENT_ENGAGE: return "engage";
+    case EVENT_STALE: return "stale";
+    case EVENT_RESUME: return "resume";
+    case EVENT_KEY: return "key";
+    case EVENT_DROPPED: return "dropped";
+    case EVENT_MARKER: return "marker";
+    case EVENT_PROFILE: return "profile";
+    default: return "unknown";
+  }
+}
+
+//* One fixed size event log record.
+struct EventRecord
+{
+  uint64_t stamp; /**< ROS time, in ns */
+  uint16_t id; /**< An EventId */
+  uint16_t thread; /**< The writer, numbered in order of the first write */
+  int32_t arg;
+  float values[4];
+};
+
+//* The header of an event log file.
+struct EventFileHeader
+{
+  char magic[8]; /**< "FOLEVT01" */
+  uint32_t record_size; /**< sizeof(EventRecord) */
+  uint32_t reserved;
+};
+
+//* Structured binary log of the follower's decisions.
+/**
+ * Writers append fixed size records to a ring of their own, with no
+ * locks and no formatting on the calling thread; a background thread
+ * collects the rings every flush period and appends the records to a
+ * file. A writer that outruns the flusher loses records rather than
+ * blocking, and the loss is logged as an event of its own.
+ *
+ * Records of different threads are only ordered within a flush; the
+ * decoder sorts them by time.
+ */
+class EventLog : boost::noncopyable
+{
+public:
+  EventLog();
+  ~EventLog();
+
+  /*!
+   * @brief Start logging to a file.
+   * Records are appended to an existing log of the same format.
+   * @param path The log file.
+   * @param period The flush period, in s.
+   * @return false if the file cannot be opened.
+   */
+  bool open(const std::string& path, double period = 0.1);
+
+  /** Flush what is left and stop the flusher. */
+  void close();
+
+  bool isOpen() const { return file_ != NULL; }
+
+  /*!
+   * @brief Log an event, stamped with the current ROS time.
+   * Does nothing unless the log is open.
+   */
+  void write(EventId id, int32_t arg = 0, float v0 = 0.0f, float v1 = 0.0f,
+             float v2 = 0.0f, float v3 = 0.0f);
+
+private:
+  //* A single producer, single consumer ring of records.
+  struct Ring
+  {
+    enum { kSize = 1024 };
+
+    Ring(uint16_t thread) : thread(thread), head(0), tail(0) {}
+
+    uint16_t thread;
+    boost::atomic<uint32_t> head; /**< Written by the owning thread */
+    boost::atomic<uint32_t> tail; /**< Written by the flusher */
+    EventRecord slots[kSize];
+  };
+
+  Ring* ring();
+  static void keepRing(Ring*) {}
+  void flush();
+  void run(double period);
+
+  FILE* file_;
+  boost::mutex rings_mutex_; /**< Guards rings_; taken once per writer thread and per flush */
+  std::vector<boost::shared_ptr<Ring> > rings_;
+  boost::thread_specific_ptr<Ring> local_; /**< This thread's ring; owned by rings_ */
+  boost::atomic<uint32_t> dropped_;
+  std::vector<EventRecord> batch_;
+  boost::scoped_ptr<boost::thread> flusher_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_EVENT_LOG_H
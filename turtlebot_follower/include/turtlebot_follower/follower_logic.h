@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_FOLLOWER_LOGIC_H
+#define TURTLEBOT_FOLLOWER_FOLLOWER_LOGIC_H
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "turtlebot_follower/FollowerConfig.h"
+#include "turtlebot_follower/local_planner.h"
+#include "turtlebot_follower/polar_histogram.h"
+#include "turtlebot_follower/ray_table.h"
+
+namespace turtlebot_follower
+{
+
+//* The perception a state needs.
+struct ResourceProfile
+{
+  ResourceProfile() : active(true), depth_rate(0.0), detector_rate(0.0) {}
+
+  bool active; /**< Whether the depth and face inputs are subscribed at all */
+  double depth_rate; /**< The depth frames processed per second and camera, 0 for every frame */
+  double detector_rate; /**< The images sent to the face detector per second, 0 for every one */
+
+  bool operator==(const ResourceProfile& other) const
+  {
+    return active == other.active && depth_rate == other.depth_rate &&
+           detector_rate == other.detector_rate;
+  }
+  bool operator!=(const ResourceProfile& other) const { return !(*this == other); }
+};
+
+//* The follower's state machine.
+/**
+ * Decides what the robot does from the latest face and the merged
+ * obstacle picture: search, steer around an obstacle, drive to the
+ * person or engage them. It has no ROS dependencies beyond the
+ * configuration, so the nodelet and the simulator run the same
+ * decisions.
+ *
+ * Each state gives both a fixed velocity command and a goal for the
+ * local planner, which drives there around the obstacles instead.
+ *
+ * Forward speed drops in proportion as the time to collision ahead
+ * gets short. Boxed in, the robot only backs off from something that
+ * closes in on it, and otherwise turns on the spot.
+ *
+ * Each state also declares the perception it needs, see profile().
+ */
+class FollowerLogic
+{
+public:
+  enum State
+  {
+    SEARCH = 0,
+    AVOID_OBSTACLE = 1,
+    MOVE_TO_HUMAN = 2,
+    ENGAGE = 3
+  };
+
+  FollowerLogic() : face_found_(false), x_face_(0.0f), y_face_(0.0f),
+                    close_to_human_(false), obstacle_(false), rear_blocked_(false),
+                    steer_found_(false), steer_bearing_(0.0), steer_balance_(0.0f), away_(0.0),
+                    search_valid_(false), search_error_(0.0),
+                    ttc_(std::numeric_limits<double>::infinity()), greeting_(false), state_(SEARCH)
+  {
+  }
+
+  /*!
+   * @brief Take the first face of a detection.
+   * The position is smoothed over the previous detections.
+   * @param center_x The horizontal face center in the 640 pixel image.
+   * @param center_y The vertical face center.
+   * @param width The face width in pixels; wide faces are close.
+   * @param yaw_change How far the robot turned since the image was
+   *                   taken, positive to the left; the face has moved
+   *                   the other way in the image since.
+   */
+  void seeFace(double center_x, double center_y, double width, double yaw_change = 0.0)
+  {
+    y_face_ = ((center_y - 320.0)/640.0 + y_face_)/2.0;
+    x_face_ = ((center_x - 320.0)/640.0 + yaw_change / kHorizontalFov + x_face_)/2.0;
+    face_found_ = true;
+    close_to_human_ = width > 100;
+  }
+
+  void loseFace()
+  {
+    face_found_ = false;
+    close_to_human_ = false;
+  }
+
+  /*!
+   * @brief Take the merged obstacle picture and steer around it.
+   * @param config The configuration.
+   * @param blocked Whether the box ahead holds an obstacle.
+   * @param rear_blocked Whether backing off is unsafe.
+   * @param histogram The obstacle histogram ahead, or NULL to keep the
+   *                  last steering.
+   */
+  void setObstacles(const FollowerConfig& config, bool blocked, bool rear_blocked,
+                    const PolarHistogram* histogram)
+  {
+    obstacle_ = blocked;
+    rear_blocked_ = rear_blocked;
+    if (!histogram)
+      return;
+    // Head for the tracked face, or straight on while searching
+    double target = face_found_ ? x_face_ * kHorizontalFov : 0.0;
+    steer_found_ = histogram->steer(target, config.sector_threshold, config.free_sectors, steer_bearing_);
+    steer_balance_ = histogram->balance();
+  }
+
+  /*!
+   * @brief Set the heading the search should turn to.
+   * @param valid Whether there is a heading; without one the search drives straight on.
+   * @param error The heading relative to the robot, positive to the left.
+   */
+  void setSearchHeading(bool valid, double error)
+  {
+    search_valid_ = valid;
+    search_error_ = error;
+  }
+
+  /*!
+   * @brief Set the shortest time to collision ahead.
+   * @param ttc The time to collision in s, infinite if nothing closes in.
+   */
+  void setCollisionTime(double ttc) { ttc_ = ttc; }
+
+  /*!
+   * @brief Hold the engagement while the robot greets.
+   * @param greeting Whether a greeting is under way; ENGAGE holds for as
+   *                 long as the face stays in view, close or not.
+   */
+  void setGreeting(bool greeting) { greeting_ = greeting; }
+
+  /*!
+   * @brief Pick the state and the velocity command of that state.
+   * Also sets the goal of the state, see goal().
+   * @param linear The forward velocity.
+   * @param angular The rotational velocity.
+   * @return The state; the command is zero while engaging.
+   */
+  State decide(const FollowerConfig& config, double& linear, double& angular)
+  {
+    linear = 0.0;
+    angular = 0.0;
+    goal_ = MotionGoal();
+    if (greeting_ && face_found_)
+      state_ = ENGAGE;
+    else if (!face_found_ && !obstacle_ && !close_to_human_)
+      state_ = SEARCH;
+    else if (obstacle_ && !close_to_human_)
+      state_ = AVOID_OBSTACLE;
+    else if (face_found_ && !obstacle_ && !close_to_human_)
+      state_ = MOVE_TO_HUMAN;
+    else if (face_found_ && close_to_human_)
+      state_ = ENGAGE;
+    else
+      state_ = SEARCH;
+    if (state_ != AVOID_OBSTACLE || steer_found_)
+      away_ = 0.0;
+
+    switch (state_)
+    {
+      case SEARCH:
+        linear = config.search_speed;
+        if (search_valid_ && config.search_turn_gain > 0.0)
+        {
+          // Turn on the spot towards a heading behind us, drive while it is ahead
+          linear *= std::max(0.0, cos(search_error_));
+          angular = std::max(-1.0, std::min(1.0, search_error_ * config.search_turn_gain));
+        }
+        setGoal(search_valid_ ? search_error_ : 0.0, config.search_speed, 0.0);
+        break;
+      case AVOID_OBSTACLE:
+        if (steer_found_)
+        {
+          // Keep moving, steering into the free sector closest to the target
+          linear = config.avoid_speed;
+          angular = -steer_bearing_ * config.z_scale;
+          setGoal(-steer_bearing_, config.avoid_speed, 0.0);
+        }
+        else
+        {
+          // Boxed in: turn towards the emptier side without creeping
+          // forward, backing off slowly only from something closing in,
+          // and only if nothing is behind us. The side holds until a gap
+          // opens, turning in place would otherwise rock between the two.
+          if (away_ == 0.0)
+            away_ = (steer_balance_ > 0 ? 0.5 : -0.5) * kHorizontalFov;
+          const bool back_off = !rear_blocked_ && ttc_ < config.ttc_stop;
+          linear = back_off ? -config.avoid_speed : 0.0;
+          angular = -away_ * config.z_scale;
+          setGoal(-away_, back_off ? -config.avoid_speed : 0.0, back_off ? config.avoid_speed : 0.0);
+        }
+        break;
+      case MOVE_TO_HUMAN:
+        linear = 0.2;//(z - goal_z_) * z_scale_;
+        angular = -x_face_ * config.z_scale;
+        setGoal(-x_face_ * kHorizontalFov, 0.2, 0.0);
+        break;
+      case ENGAGE:
+        break;
+    }
+
+    // Slow down ahead of a collision rather than run into the box
+    const double scale = collisionScale(config);
+    if (linear > 0.0)
+      linear *= scale;
+    goal_.speed *= scale;
+    return state_;
+  }
+
+  /*!
+   * @brief The perception the current state needs.
+   * Driving needs every frame. While engaging, the robot stands still,
+   * and a search that has not seen anybody for a while can look less
+   * often.
+   * @param low_power Whether no face was seen for low_power_delay.
+   */
+  ResourceProfile profile(const FollowerConfig& config, bool low_power) const
+  {
+    ResourceProfile profile;
+    if (!config.duty_cycling)
+      return profile;
+    if (state_ == ENGAGE)
+    {
+      profile.depth_rate = config.engage_depth_rate;
+      profile.detector_rate = config.engage_detector_rate;
+    }
+    else if (state_ == SEARCH && low_power)
+    {
+      profile.depth_rate = config.low_power_depth_rate;
+      profile.detector_rate = config.low_power_detector_rate;
+    }
+    return profile;
+  }
+
+  static const char* stateName(int state)
+  {
+    switch (state)
+    {
+      case SEARCH: return "SEARCH";
+      case AVOID_OBSTACLE: return "AVOID OBSTACLE";
+      case MOVE_TO_HUMAN: return "MOVE TO HUMAN";
+      case ENGAGE: return "ENGAGE";
+      default: return "UNKNOWN";
+    }
+  }
+
+  bool faceFound() const { return face_found_; }
+  bool greeting() const { return greeting_; }
+  /** The smoothed face position, -0.5 (left) to 0.5 (right) of the image. */
+  float xFace() const { return x_face_; }
+  bool closeToHuman() const { return close_to_human_; }
+  bool obstacle() const { return obstacle_; }
+  bool steerFound() const { return steer_found_; }
+  double collisionTime() const { return ttc_; }
+  /** The goal of the current state for the local planner. */
+  const MotionGoal& goal() const { return goal_; }
+  double steerBearing() const { return steer_bearing_; }
+  State state() const { return state_; }
+
+private:
+  /** The forward speed scaling for the time to collision, 0 at ttc_stop to 1 at ttc_slow. */
+  double collisionScale(const FollowerConfig& config) const
+  {
+    if (ttc_ <= config.ttc_stop)
+      return 0.0;
+    if (ttc_ >= config.ttc_slow)
+      return 1.0;
+    return (ttc_ - config.ttc_stop) / (config.ttc_slow - config.ttc_stop);
+  }
+
+  void setGoal(double bearing, double speed, double reverse)
+  {
+    goal_.stop = false;
+    goal_.bearing = bearing;
+    goal_.speed = speed;
+    goal_.reverse = reverse;
+  }
+
+  bool face_found_;
+  float x_face_;
+  float y_face_;
+  bool close_to_human_;
+
+  bool obstacle_; /**< Whether there is an obstacle ahead */
+  bool rear_blocked_; /**< Whether a rear camera sees an obstacle or has gone stale */
+  bool steer_found_; /**< Whether the histogram has a gap to steer into */
+  double steer_bearing_; /**< The bearing of that gap, positive to the right */
+  float steer_balance_; /**< Obstacle density on the left minus on the right */
+  double away_; /**< The bearing a boxed-in robot turns away to, 0 while not boxed in */
+  bool search_valid_; /**< Whether the search planner chose a heading */
+  double search_error_; /**< The bearing of that heading, positive to the left */
+  double ttc_; /**< The shortest time to collision ahead, in s */
+  bool greeting_; /**< Whether the robot is greeting the person it engaged */
+
+  State state_;
+  MotionGoal goal_; /**< Where the current state wants to go */
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_FOLLOWER_LOGIC_H
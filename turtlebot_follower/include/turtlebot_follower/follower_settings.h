@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_FOLLOWER_SETTINGS_H
+#define TURTLEBOT_FOLLOWER_FOLLOWER_SETTINGS_H
+
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+#include <boost/shared_ptr.hpp>
+#include <visualization_msgs/Marker.h>
+#include "turtlebot_follower/FollowerConfig.h"
+#include "turtlebot_follower/ray_table.h"
+
+namespace turtlebot_follower
+{
+
+//* The part of the height band where points count as an obstacle.
+struct ObstacleBox
+{
+  float min_x, max_x; /**< The lateral limits, x to the right, in m */
+  float max_z; /**< The look-ahead, in m */
+  uint16_t max_z_mm; /**< max_z for 16 bit depth images, in mm */
+};
+
+//* An immutable snapshot of the follower configuration.
+/**
+ * Built once per dynamic_reconfigure update (an epoch) together with
+ * everything derived from it, and then only ever read. The nodelet
+ * swaps the shared pointer atomically, so the depth callback sees
+ * either the old or the new box limits for a whole frame, never a mix.
+ */
+struct FollowerSettings
+{
+  /*!
+   * @brief Build the snapshot and its derived values.
+   * @param config The dynamic_reconfigure configuration.
+   * @param epoch The sequence number of the configuration.
+   */
+  FollowerSettings(const FollowerConfig& config, uint64_t epoch)
+    : config(config), epoch(epoch)
+  {
+    reach = std::max(config.max_z, config.histogram_range);
+    if (config.adaptive_box)
+      reach = std::max(reach, (float)config.max_look_ahead);
+    box.min_x = config.min_x;
+    box.max_x = config.max_x;
+    box.max_z = config.max_z;
+    box.max_z_mm = toMillimeters(config.max_z);
+    reach_mm = toMillimeters(reach);
+    buildBbox();
+  }
+
+  FollowerConfig config; /**< The raw configuration. */
+  uint64_t epoch; /**< Increases with every reconfigure. */
+
+  float reach; /**< The farthest depth any stage of the obstacle pass looks at. */
+  ObstacleBox box; /**< The obstacle box at standstill. */
+  uint16_t reach_mm; /**< reach for 16 bit depth images, in mm. */
+  visualization_msgs::Marker bbox; /**< The box of points the obstacle pass considers. */
+
+  /*!
+   * @brief The obstacle box for a camera moving at a velocity.
+   * The box reaches as far ahead as the robot travels before it can
+   * stop, on top of the standstill clearance, and widens towards the
+   * side the robot turns to by how far its arc drifts over that
+   * distance.
+   * @param linear The forward velocity of the camera, in m/s.
+   * @param angular The rotational velocity, positive to the left, in rad/s.
+   */
+  ObstacleBox lookAhead(double linear, double angular) const
+  {
+    if (!config.adaptive_box || linear <= 0.0)
+      return box;
+    ObstacleBox adapted = box;
+    double stop = linear * config.reaction_time + linear * linear / (2.0 * config.decel_limit);
+    adapted.max_z = std::min(box.max_z + (float)stop, reach);
+    adapted.max_z_mm = toMillimeters(adapted.max_z);
+
+    // The arc drifts by curvature * d^2 / 2; turning left drifts to -x
+    double drift = angular / linear * adapted.max_z * adapted.max_z / 2.0;
+    double limit = box.max_x - box.min_x;
+    drift = std::max(-limit, std::min(limit, drift));
+    if (drift > 0.0)
+      adapted.min_x -= drift;
+    else
+      adapted.max_x -= drift;
+    return adapted;
+  }
+
+  /*!
+   * @brief Find the image rows that can hold points inside the box.
+   * A row whose points all fall above or below the box for every depth
+   * up to reach is culled before the per-pixel tests.
+   * @param rays The ray table of the current resolution.
+   * @param begin The first row to process.
+   * @param end One past the last row to process.
+   */
+  void rowBounds(const RayTable& rays, int& begin, int& end) const
+  {
+    const std::vector<float>& sin_y = rays.sinY();
+    const int height = sin_y.size();
+    begin = height;
+    end = 0;
+    for (int v = 0; v < height; ++v)
+    {
+      // Heights reachable on this row lie between 0 and sin_y * reach
+      float a = std::min(0.0f, sin_y[v] * reach);
+      float b = std::max(0.0f, sin_y[v] * reach);
+      if (b > config.min_y && a < config.max_y)
+      {
+        begin = std::min(begin, v);
+        end = v + 1;
+      }
+    }
+    if (begin >= end)
+      begin = end = 0;
+  }
+
+private:
+  static uint16_t toMillimeters(double meters)
+  {
+    return (uint16_t)std::min(65535.0, std::max(0.0, floor(meters * 1000.0 + 0.5)));
+  }
+
+  void buildBbox()
+  {
+    double x = (config.min_x + config.max_x)/2;
+    double y = (config.min_y + config.max_y)/2;
+    double z = (0 + config.max_z)/2;
+
+    bbox.header.frame_id = "/camera_rgb_optical_frame";
+    bbox.ns = "my_namespace";
+    bbox.id = 1;
+    bbox.type = visualization_msgs::Marker::CUBE;
+    bbox.action = visualization_msgs::Marker::ADD;
+    bbox.pose.position.x = x;
+    bbox.pose.position.y = -y;
+    bbox.pose.position.z = z;
+    bbox.pose.orientation.x = 0.0;
+    bbox.pose.orientation.y = 0.0;
+    bbox.pose.orientation.z = 0.0;
+    bbox.pose.orientation.w = 1.0;
+    bbox.scale.x = (config.max_x - x)*2;
+    bbox.scale.y = (config.max_y - y)*2;
+    bbox.scale.z = (config.max_z - z)*2;
+    bbox.color.a = 0.5;
+    bbox.color.r = 0.0;
+    bbox.color.g = 1.0;
+    bbox.color.b = 0.0;
+  }
+};
+
+typedef boost::shared_ptr<const FollowerSettings> FollowerSettingsConstPtr;
+
+//* The depth limits of a snapshot in the units of a depth image type.
+template<typename T> struct RawDepth;
+
+template<> struct RawDepth<float>
+{
+  static float maxZ(const ObstacleBox& b) { return b.max_z; }
+  static float reach(const FollowerSettings& s) { return s.reach; }
+};
+
+template<> struct RawDepth<uint16_t>
+{
+  static uint16_t maxZ(const ObstacleBox& b) { return b.max_z_mm; }
+  static uint16_t reach(const FollowerSettings& s) { return s.reach_mm; }
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_FOLLOWER_SETTINGS_H
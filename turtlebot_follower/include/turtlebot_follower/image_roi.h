@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_IMAGE_ROI_H
+#define TURTLEBOT_FOLLOWER_IMAGE_ROI_H
+
+#include <algorithm>
+#include <string>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+
+namespace turtlebot_follower
+{
+
+//* A region of a full resolution image, sampled every binning pixels.
+struct ImageRoi
+{
+  ImageRoi() : x(0), y(0), width(0), height(0), binning(1) {}
+  ImageRoi(int x, int y, int width, int height, int binning)
+    : x(x), y(y), width(width), height(height), binning(binning) {}
+
+  int x, y; /**< The top left corner, in full resolution pixels. */
+  int width, height; /**< The size, in full resolution pixels. */
+  int binning; /**< The downscaling factor. */
+
+  /** Clip the region to an image of the given size. */
+  void clip(int image_width, int image_height)
+  {
+    x = std::min(std::max(x, 0), image_width);
+    y = std::min(std::max(y, 0), image_height);
+    width = std::max(0, std::min(width, image_width - x));
+    height = std::max(0, std::min(height, image_height - y));
+    binning = std::max(binning, 1);
+  }
+};
+
+/** The number of 8 bit channels of an encoding we can crop, or 0. */
+inline int byteChannels(const std::string& encoding)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  if (encoding == enc::MONO8)
+    return 1;
+  if (encoding == enc::RGB8 || encoding == enc::BGR8)
+    return 3;
+  if (encoding == enc::RGBA8 || encoding == enc::BGRA8)
+    return 4;
+  return 0;
+}
+
+/*!
+ * @brief Crop a region out of an 8 bit image and downscale it.
+ * Each output pixel is the mean of a binning x binning block of the
+ * input, which keeps the small faces the detector looks for from
+ * aliasing away. The output keeps the header and encoding of the
+ * input and reuses the capacity of out's data buffer.
+ * @param in The full resolution image.
+ * @param roi The region, clipped to the image.
+ * @param out The cropped image.
+ * @return false if the encoding is not 8 bit per channel.
+ */
+inline bool cropDecimate(const sensor_msgs::Image& in, const ImageRoi& roi, sensor_msgs::Image& out)
+{
+  const int channels = byteChannels(in.encoding);
+  if (channels == 0)
+    return false;
+
+  const int b = roi.binning;
+  const int out_width = roi.width / b;
+  const int out_height = roi.height / b;
+  out.header = in.header;
+  out.encoding = in.encoding;
+  out.is_bigendian = in.is_bigendian;
+  out.width = out_width;
+  out.height = out_height;
+  out.step = out_width * channels;
+  out.data.resize(out.step * out_height);
+
+  const int row_len = out_width * channels;
+  std::vector<unsigned int> sums(row_len);
+  for (int v = 0; v < out_height; ++v)
+  {
+    std::fill(sums.begin(), sums.end(), 0u);
+    for (int dy = 0; dy < b; ++dy)
+    {
+      const uint8_t* src = &in.data[(roi.y + v * b + dy) * in.step + roi.x * channels];
+      for (int u = 0; u < out_width; ++u)
+        for (int dx = 0; dx < b; ++dx)
+          for (int c = 0; c < channels; ++c)
+            sums[u * channels + c] += *src++;
+    }
+    uint8_t* dst = &out.data[v * out.step];
+    const unsigned int block = b * b;
+    for (int i = 0; i < row_len; ++i)
+      dst[i] = sums[i] / block;
+  }
+  return true;
+}
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_IMAGE_ROI_H
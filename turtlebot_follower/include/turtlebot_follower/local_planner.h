@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_LOCAL_PLANNER_H
+#define TURTLEBOT_FOLLOWER_LOCAL_PLANNER_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "turtlebot_follower/FollowerConfig.h"
+#include "turtlebot_follower/polar_histogram.h"
+
+namespace turtlebot_follower
+{
+
+/** Where a state of the follower wants to go. */
+struct MotionGoal
+{
+  MotionGoal() : stop(true), bearing(0.0), speed(0.0), reverse(0.0) {}
+
+  bool stop; /**< Whether to hold still */
+  double bearing; /**< The direction to head in, relative to the robot, positive to the left */
+  double speed; /**< The fastest forward speed wanted, in m/s */
+  double reverse; /**< The fastest backward speed allowed, in m/s */
+};
+
+//* A dynamic window local planner.
+/**
+ * Samples the velocities the base can reach within one control period
+ * under its acceleration limits, rolls each out as an arc over a short
+ * horizon against the nearest obstacle points of the depth cameras,
+ * and picks the one that best combines heading to the goal, clearance
+ * and speed. Velocities the robot could not brake from before the
+ * nearest obstacle are left out.
+ *
+ * Obstacles are points in the robot frame, x forward and y to the
+ * left, stored as arrays of x and y padded to whole SSE vectors.
+ * They are remembered for a while and moved along with the odometry,
+ * so that obstacles closer than the minimum range of the cameras, or
+ * beside the robot, still count; a camera replaces the remembered
+ * points it sees again.
+ */
+class LocalPlanner
+{
+public:
+  LocalPlanner() : count_(0), last_plan_(0.0), has_pose_(false), pose_x_(0.0), pose_y_(0.0),
+                   pose_yaw_(0.0), now_(0.0) {}
+
+  void clearObstacles()
+  {
+    count_ = 0;
+    has_pose_ = false;
+    std::fill(obstacle_x_.begin(), obstacle_x_.end(), kNoDepth);
+    std::fill(obstacle_y_.begin(), obstacle_y_.end(), kNoDepth);
+  }
+
+  /*!
+   * @brief Start collecting the obstacles of a new plan.
+   * Keeps the points of the last memory seconds, moved into the robot
+   * frame at the new pose.
+   * @param now The current time, in s.
+   * @param x The robot position in the odometry frame.
+   * @param y The robot position in the odometry frame.
+   * @param yaw The robot heading in the odometry frame.
+   * @param memory How long points are kept, in s; 0 keeps none.
+   */
+  void moveObstacles(double now, double x, double y, double yaw, double memory)
+  {
+    if (!has_pose_ || memory <= 0.0)
+      clearObstacles();
+    // The old robot frame seen from the new one
+    const double dyaw = yaw - pose_yaw_;
+    const double c = cos(dyaw), s = sin(dyaw);
+    const double wx = x - pose_x_, wy = y - pose_y_;
+    const double tx = cos(-yaw) * wx - sin(-yaw) * wy, ty = sin(-yaw) * wx + cos(-yaw) * wy;
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count_; ++i)
+    {
+      if (obstacle_stamp_[i] < now - memory)
+        continue;
+      const double px = obstacle_x_[i], py = obstacle_y_[i];
+      obstacle_x_[kept] = c * px + s * py - tx;
+      obstacle_y_[kept] = -s * px + c * py - ty;
+      obstacle_stamp_[kept] = obstacle_stamp_[i];
+      ++kept;
+    }
+    std::fill(obstacle_x_.begin() + kept, obstacle_x_.end(), kNoDepth);
+    std::fill(obstacle_y_.begin() + kept, obstacle_y_.end(), kNoDepth);
+    count_ = kept;
+    has_pose_ = true;
+    pose_x_ = x;
+    pose_y_ = y;
+    pose_yaw_ = yaw;
+    now_ = now;
+  }
+
+  /** Add an obstacle point in the robot frame. */
+  void addObstacle(float x, float y)
+  {
+    if (count_ == obstacle_x_.size())
+    {
+      obstacle_x_.resize(count_ + 4, kNoDepth);
+      obstacle_y_.resize(count_ + 4, kNoDepth);
+      obstacle_stamp_.resize(count_ + 4);
+    }
+    obstacle_x_[count_] = x;
+    obstacle_y_[count_] = y;
+    obstacle_stamp_[count_] = now_;
+    ++count_;
+  }
+
+  /*!
+   * @brief Add the nearest point of every occupied sector of a camera.
+   * Each sector gives a point at its center and at both edges. The
+   * remembered points the camera sees now are replaced.
+   * @param histogram The obstacle histogram of the camera.
+   * @param camera_x The mounting position of the camera on the base,
+   * forward of its center.
+   * @param camera_y The mounting position to the left of the center.
+   * @param camera_yaw The mounting yaw of the camera on the base.
+   * @param min_range The depth below which the camera is blind.
+   * @param max_range The depth up to which the histogram holds points.
+   */
+  void addObstacles(const PolarHistogram& histogram, double camera_x, double camera_y,
+                    double camera_yaw, double min_range, double max_range)
+  {
+    const double half_sector = 0.5 * histogram.sectorWidth();
+    const double half_fov = half_sector * histogram.size();
+    const double c = cos(camera_yaw), s = sin(camera_yaw);
+    size_t kept = 0;
+    for (size_t i = 0; i < count_; ++i)
+    {
+      const double dx = obstacle_x_[i] - camera_x, dy = obstacle_y_[i] - camera_y;
+      const double forward = dx * c + dy * s;
+      const double left = dy * c - dx * s;
+      const bool visible = forward > min_range && forward < max_range &&
+                           fabs(atan2(left, forward)) < half_fov;
+      if (visible && obstacle_stamp_[i] < now_)
+        continue;
+      obstacle_x_[kept] = obstacle_x_[i];
+      obstacle_y_[kept] = obstacle_y_[i];
+      obstacle_stamp_[kept] = obstacle_stamp_[i];
+      ++kept;
+    }
+    std::fill(obstacle_x_.begin() + kept, obstacle_x_.end(), kNoDepth);
+    std::fill(obstacle_y_.begin() + kept, obstacle_y_.end(), kNoDepth);
+    count_ = kept;
+
+    for (int i = 0; i < histogram.size(); ++i)
+    {
+      if (!histogram.occupied(i))
+        continue;
+      const double forward = histogram.nearest(i);
+      for (int edge = -1; edge <= 1; ++edge)
+      {
+        // Histogram bearings are positive to the right
+        double right = forward * tan(histogram.bearingOf(i) + edge * half_sector);
+        addObstacle(camera_x + forward * c + right * s, camera_y + forward * s - right * c);
+      }
+    }
+  }
+
+  size_t obstacles() const { return count_; }
+
+  /*!
+   * @brief Pick the velocity command towards a goal.
+   * @param now The current time, in s; the window spans the time since the last plan.
+   * @param config The configuration.
+   * @param goal Where to go.
+   * @param linear_now The current forward velocity of the base.
+   * @param angular_now The current rotational velocity, positive to the left.
+   * @param linear The chosen forward velocity.
+   * @param angular The chosen rotational velocity.
+   * @return false if every velocity in the window collides; the
+   *         command then brakes as hard as the window allows.
+   */
+  bool plan(double now, const FollowerConfig& config, const MotionGoal& goal,
+            double linear_now, double angular_now, double& linear, double& angular)
+  {
+    const double dt = std::min(std::max(now - last_plan_, 0.05), 0.25);
+    last_plan_ = now;
+    linear = 0.0;
+    angular = 0.0;
+    if (goal.stop)
+      return true;
+
+    double v_lo = std::max(linear_now - config.accel_limit * dt, -goal.reverse);
+    double v_hi = std::min(linear_now + config.accel_limit * dt, goal.speed);
+    // Too fast for the goal: slow down as hard as possible
+    if (v_lo > v_hi)
+      v_lo = v_hi = linear_now > 0.0 ? v_lo : v_hi;
+    double w_lo = std::max(angular_now - config.turn_accel_limit * dt, -config.max_turn_rate);
+    double w_hi = std::min(angular_now + config.turn_accel_limit * dt, config.max_turn_rate);
+    if (w_lo > w_hi)
+      w_lo = w_hi = angular_now > 0.0 ? w_lo : w_hi;
+
+    const float radius = config.robot_radius;
+    const double horizon = config.planner_horizon;
+    const float start = sqrt(nearestSquared(0.0f, 0.0f)) - radius;
+    bool found = false;
+    double best_score = 0.0;
+    for (int i = 0; i < kLinearSamples; ++i)
+    {
+      const double v = v_lo + (v_hi - v_lo) * i / (kLinearSamples - 1);
+      for (int j = 0; j < kAngularSamples; ++j)
+      {
+        const double w = w_lo + (w_hi - w_lo) * j / (kAngularSamples - 1);
+        float clearance = rollout(v, w, horizon, radius, start);
+        // Moving within the clearance of an obstacle is only fine
+        // while it does not get any closer
+        if (clearance < 0.0f && clearance < start - 0.01f)
+          continue;
+        if (fabs(v) > sqrt(2.0 * config.decel_limit * std::max(clearance, 0.0f)))
+          continue;
+
+        double heading = 1.0 - fabs(remainder(goal.bearing - w * horizon, 2.0 * M_PI)) / M_PI;
+        double clear = std::min(std::max(clearance, 0.0f), 1.0f);
+        double speed = std::max(v, 0.0) / std::max(goal.speed, 0.05);
+        double score = config.heading_weight * heading + config.clearance_weight * clear +
+                       config.velocity_weight * speed;
+        if (!found || score > best_score)
+        {
+          found = true;
+          best_score = score;
+          linear = v;
+          angular = w;
+        }
+      }
+    }
+    if (!found)
+      linear = linear_now > 0.0 ? std::max(v_lo, 0.0) : std::min(v_hi, 0.0);
+    return found;
+  }
+
+private:
+  static const int kLinearSamples = 11;
+  static const int kAngularSamples = 21;
+  static const int kRolloutSteps = 15;
+
+  /*!
+   * @brief The smallest clearance along an arc, in m.
+   * Stops early once the arc runs into an obstacle from free space.
+   */
+  float rollout(double v, double w, double horizon, float radius, float start) const
+  {
+    float nearest = kNoDepth;
+    for (int k = 1; k <= kRolloutSteps; ++k)
+    {
+      const double t = horizon * k / kRolloutSteps;
+      double x, y;
+      if (fabs(w) < 1e-3)
+      {
+        x = v * t;
+        y = 0.0;
+      }
+      else
+      {
+        x = v / w * sin(w * t);
+        y = v / w * (1.0 - cos(w * t));
+      }
+      nearest = std::min(nearest, nearestSquared(x, y));
+      if (sqrt(nearest) < radius && start >= 0.0f)
+        break;
+    }
+    return sqrt(nearest) - radius;
+  }
+
+  /** The squared distance from a point to the nearest obstacle. */
+  float nearestSquared(float x, float y) const
+  {
+    float best = kNoDepth;
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 px = _mm_set1_ps(x), py = _mm_set1_ps(y);
+    __m128 acc = _mm_set1_ps(best);
+    for (; i + 4 <= count_; i += 4)
+    {
+      __m128 dx = _mm_sub_ps(_mm_loadu_ps(&obstacle_x_[i]), px);
+      __m128 dy = _mm_sub_ps(_mm_loadu_ps(&obstacle_y_[i]), py);
+      acc = _mm_min_ps(acc, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+    }
+    // The padding beyond count_ is far away
+    if (i < count_)
+    {
+      __m128 dx = _mm_sub_ps(_mm_loadu_ps(&obstacle_x_[i]), px);
+      __m128 dy = _mm_sub_ps(_mm_loadu_ps(&obstacle_y_[i]), py);
+      acc = _mm_min_ps(acc, _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+      i = count_;
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    best = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+#endif
+    for (; i < count_; ++i)
+    {
+      float dx = obstacle_x_[i] - x, dy = obstacle_y_[i] - y;
+      best = std::min(best, dx * dx + dy * dy);
+    }
+    return best;
+  }
+
+  std::vector<float> obstacle_x_; /**< Padded with far points to a multiple of 4 */
+  std::vector<float> obstacle_y_;
+  std::vector<double> obstacle_stamp_; /**< When each point was seen */
+  size_t count_; /**< The number of real obstacle points */
+  double last_plan_; /**< When the last command was planned */
+
+  bool has_pose_; /**< Whether the points are relative to a known pose */
+  double pose_x_; /**< The pose of the robot frame of the points, in the odometry frame */
+  double pose_y_;
+  double pose_yaw_;
+  double now_; /**< The time of the points added now */
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_LOCAL_PLANNER_H
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_OBSTACLE_REDUCER_H
+#define TURTLEBOT_FOLLOWER_OBSTACLE_REDUCER_H
+
+#include <stdint.h>
+#include <vector>
+#include <sensor_msgs/PointCloud2.h>
+#include "turtlebot_follower/depth_denoiser.h"
+#include "turtlebot_follower/depth_pyramid.h"
+#include "turtlebot_follower/follower_settings.h"
+#include "turtlebot_follower/polar_histogram.h"
+#include "turtlebot_follower/ray_table.h"
+
+namespace turtlebot_follower
+{
+
+/** The points of a depth frame inside the obstacle box. */
+struct BoxStats
+{
+  unsigned int n; /**< The number of samples in the box */
+  float x, y; /**< The sums of their x and y positions */
+  float z; /**< The closest depth */
+  float area; /**< Their frontal area, in m^2 */
+};
+
+//* The obstacle pass over one depth frame.
+/**
+ * Reduces a depth image or an organized point cloud into the samples
+ * inside the obstacle box, the polar histogram and optionally the
+ * ranges of a laser scan. Keeps the ray table, histogram and denoiser
+ * of one camera between frames; it does not depend on how the frames
+ * arrive, so the nodelet and the simulator share it.
+ *
+ * Full resolution depth images first go into a minimum depth pyramid
+ * over the obstacle rows, and the pass skips the 8x8 tiles with
+ * nothing within reach, or the whole frame when the pyramid says it
+ * is clear.
+ */
+class ObstacleReducer
+{
+public:
+  ObstacleReducer();
+
+  /*!
+   * @brief Set up for the size and configuration of the next frame.
+   * @return true if anything had to be set up again.
+   */
+  bool prepare(uint32_t width, uint32_t height, const FollowerSettings& settings);
+
+  /** Use another obstacle box than the standstill one from the next frame on. */
+  void setBox(const ObstacleBox& box) { box_ = box; }
+  /** The obstacle box of the last frame. */
+  const ObstacleBox& box() const { return box_; }
+
+  /*!
+   * @brief Reduce a depth image.
+   * @param depth_data The depth image, uint16_t millimeters or float meters.
+   * @param row_step The distance between image rows, in elements.
+   * @param settings The configuration of this frame.
+   * @param stride The pixel stride of the obstacle pass.
+   * @param ranges The laser scan ranges to fill, or NULL.
+   * @return The samples inside the box.
+   */
+  template<typename T>
+  BoxStats reduceImage(const T* depth_data, int row_step, const FollowerSettings& settings,
+                       int stride, std::vector<float>* ranges);
+
+  BoxStats reduceCloud(const sensor_msgs::PointCloud2& cloud, const uint32_t offsets[3],
+                       const FollowerSettings& settings, int stride,
+                       std::vector<float>* ranges);
+
+  static bool xyzOffsets(const sensor_msgs::PointCloud2& cloud, uint32_t offsets[3]);
+  static bool holdsPoints(const sensor_msgs::PointCloud2& cloud);
+
+  const RayTable& rays() const { return rays_; }
+  /** The histogram of the last frame. */
+  const PolarHistogram& histogram() const { return histogram_; }
+
+private:
+  template<typename T>
+  void reduceScanRow(const T* depth_row, std::vector<float>& ranges);
+
+  template<typename T>
+  BoxStats reduceDepth(const T* data, int row_pitch, int pixel_pitch,
+                       const FollowerSettings& settings, int stride, const DepthPyramid* pyramid);
+
+  RayTable rays_; /**< Cached ray directions of the depth image */
+  PolarHistogram histogram_; /**< Obstacle density per bearing sector */
+  DepthDenoiser denoiser_; /**< Median filter ahead of the obstacle pass */
+  DepthPyramid pyramid_; /**< Min/max depth of the obstacle rows of the last full resolution image */
+  ObstacleBox box_; /**< The obstacle box of the next frame */
+  uint64_t applied_epoch_; /**< The configuration epoch the state was set up for */
+  int row_begin_; /**< The first image row that can hold points in the box */
+  int row_end_; /**< One past the last image row that can hold points in the box */
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_OBSTACLE_REDUCER_H
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_PERSON_MEMORY_H
+#define TURTLEBOT_FOLLOWER_PERSON_MEMORY_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <sensor_msgs/Image.h>
+#include "turtlebot_follower/image_roi.h"
+#include "turtlebot_follower/template_tracker.h"
+
+namespace turtlebot_follower
+{
+
+//* A cheap appearance descriptor of a person.
+/**
+ * An 8x8 grayscale patch of the face, zero mean and unit norm, and a
+ * 64 bin color histogram of the torso below it. The face patch alone
+ * is too coarse to tell faces apart; clothing usually is not.
+ */
+struct PersonDescriptor
+{
+  enum
+  {
+    kPatch = 8,
+    kBins = 64
+  };
+
+  float face[kPatch * kPatch]; /**< The normalized face patch */
+  float torso[kBins]; /**< The torso histogram, summing to 1 */
+  bool has_torso; /**< Whether the torso was in the image */
+
+  /*!
+   * @brief Describe the person around a face.
+   * @param image The image the face was found in.
+   * @param cx The center of the face, in pixels.
+   * @param cy
+   * @param size The width of the face, in pixels.
+   * @return false if the encoding is not 8 bit per channel or the face is flat.
+   */
+  bool compute(const sensor_msgs::Image& image, double cx, double cy, double size)
+  {
+    const int channels = byteChannels(image.encoding);
+    if (channels == 0 || size < kPatch)
+      return false;
+
+    int scale = std::max(1, (int)(size / kPatch + 0.5));
+    int half = kPatch * scale / 2;
+    std::vector<float> patch;
+    if (!sampleGray(image, (int)cx - half, (int)cy - half, kPatch, kPatch, scale, patch))
+      return false;
+    double mean = 0.0;
+    for (int i = 0; i < kPatch * kPatch; ++i)
+      mean += patch[i];
+    mean /= kPatch * kPatch;
+    double norm = 0.0;
+    for (int i = 0; i < kPatch * kPatch; ++i)
+    {
+      face[i] = patch[i] - mean;
+      norm += face[i] * face[i];
+    }
+    if (norm < 1e-6)
+      return false;
+    for (int i = 0; i < kPatch * kPatch; ++i)
+      face[i] /= sqrt(norm);
+
+    // The torso is about two faces wide and starts a face below the chin
+    ImageRoi roi((int)(cx - size), (int)(cy + size), (int)(2 * size), (int)(2 * size), 1);
+    roi.clip(image.width, image.height);
+    std::fill(torso, torso + kBins, 0.0f);
+    const int step = std::max(1, (int)(size / 8));
+    unsigned int count = 0;
+    for (int v = roi.y; v < roi.y + roi.height; v += step)
+    {
+      const uint8_t* row = &image.data[v * image.step];
+      for (int u = roi.x; u < roi.x + roi.width; u += step)
+      {
+        const uint8_t* px = row + u * channels;
+        int c1 = channels > 1 ? px[1] : px[0];
+        int c2 = channels > 2 ? px[2] : px[0];
+        ++torso[(px[0] >> 6) * 16 + (c1 >> 6) * 4 + (c2 >> 6)];
+        ++count;
+      }
+    }
+    for (int i = 0; count > 0 && i < kBins; ++i)
+      torso[i] /= count;
+    has_torso = count > 0;
+    return true;
+  }
+
+  /** The distance to another descriptor, 0 for the same person up to 2. */
+  float distance(const PersonDescriptor& other) const
+  {
+    float correlation = 0.0f;
+    for (int i = 0; i < kPatch * kPatch; ++i)
+      correlation += face[i] * other.face[i];
+    if (!has_torso || !other.has_torso)
+      return 1.0f - correlation;
+    float overlap = 0.0f;
+    for (int i = 0; i < kBins; ++i)
+      overlap += std::min(torso[i], other.torso[i]);
+    return (1.0f - correlation) * 0.5f + (1.0f - overlap);
+  }
+};
+
+//* The people engaged recently.
+/**
+ * A fixed size table of descriptors that expire after a while. Lookups
+ * compare against every live entry, which for a few dozen people is
+ * cheaper than any index. When the table is full the entry closest to
+ * expiring is replaced.
+ */
+class PersonMemory
+{
+public:
+  PersonMemory() : ttl_(300.0), threshold_(0.5f) { configure(32, ttl_, threshold_); }
+
+  /*!
+   * @brief Size the table and set the matching limits.
+   * @param size The number of people remembered at once.
+   * @param ttl How long a person is remembered, in s.
+   * @param threshold The largest descriptor distance of the same person.
+   */
+  void configure(int size, double ttl, float threshold)
+  {
+    entries_.assign(std::max(size, 1), Entry());
+    ttl_ = ttl;
+    threshold_ = threshold;
+  }
+
+  /** Remember a person until now + ttl. */
+  void remember(const PersonDescriptor& person, double now)
+  {
+    Entry* slot = &entries_[0];
+    for (size_t i = 1; i < entries_.size(); ++i)
+      if (entries_[i].expires < slot->expires)
+        slot = &entries_[i];
+    slot->person = person;
+    slot->expires = now + ttl_;
+  }
+
+  /*!
+   * @brief Look a person up.
+   * @return Whether the nearest live entry is close enough to be the same person.
+   */
+  bool recall(const PersonDescriptor& person, double now) const
+  {
+    float best = threshold_;
+    bool found = false;
+    for (size_t i = 0; i < entries_.size(); ++i)
+    {
+      if (entries_[i].expires <= now)
+        continue;
+      float d = entries_[i].person.distance(person);
+      if (d < best)
+      {
+        best = d;
+        found = true;
+      }
+    }
+    return found;
+  }
+
+  /** The number of people remembered right now. */
+  size_t live(double now) const
+  {
+    size_t n = 0;
+    for (size_t i = 0; i < entries_.size(); ++i)
+      n += entries_[i].expires > now;
+    return n;
+  }
+
+private:
+  struct Entry
+  {
+    Entry() : expires(0.0) {}
+    PersonDescriptor person;
+    double expires; /**< When the entry is forgotten, in s */
+  };
+
+  std::vector<Entry> entries_;
+  double ttl_;
+  float threshold_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_PERSON_MEMORY_H
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_POLAR_HISTOGRAM_H
+#define TURTLEBOT_FOLLOWER_POLAR_HISTOGRAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace turtlebot_follower
+{
+
+/** The nearest depth of a sector without points. */
+const float kNoDepth = 1e6f;
+
+//* A polar obstacle histogram over the sensor field of view.
+/**
+ * Vector field histogram style obstacle density per bearing sector.
+ * The depth callback adds the weight of every near point to the
+ * sector of its image column; the controller then looks for a run
+ * of free sectors wide enough for the robot that lies closest to
+ * the bearing it wants to go.
+ *
+ * Each sector also keeps the depth of its nearest point, so that
+ * the local planner can place the obstacles metrically.
+ *
+ * Bearings are in radians, positive to the right of the image, like
+ * the column bearings of the RayTable.
+ */
+class PolarHistogram
+{
+public:
+  PolarHistogram() : fov_(0.0) {}
+
+  /*!
+   * @brief Set the number of sectors and the field of view they span.
+   * Clears the histogram.
+   */
+  void configure(int sectors, double fov)
+  {
+    fov_ = fov;
+    bins_.assign(std::max(sectors, 1), 0.0f);
+    nearest_.assign(bins_.size(), kNoDepth);
+    column_sector_.clear();
+  }
+
+  /*!
+   * @brief Map each image column to its sector.
+   * @param column_bearing The bearing of every image column.
+   */
+  void bindColumns(const std::vector<float>& column_bearing)
+  {
+    column_sector_.resize(column_bearing.size());
+    for (size_t u = 0; u < column_bearing.size(); ++u)
+      column_sector_[u] = sectorOf(column_bearing[u]);
+  }
+
+  bool bound(size_t width) const { return column_sector_.size() == width; }
+
+  void clear()
+  {
+    std::fill(bins_.begin(), bins_.end(), 0.0f);
+    std::fill(nearest_.begin(), nearest_.end(), kNoDepth);
+  }
+
+  /** Add the weight of a point at a depth to the sector of image column u. */
+  void addColumn(int u, float weight, float depth)
+  {
+    const int sector = column_sector_[u];
+    bins_[sector] += weight;
+    nearest_[sector] = std::min(nearest_[sector], depth);
+  }
+
+  int size() const { return bins_.size(); }
+  float density(int sector) const { return bins_[sector]; }
+
+  /** Whether any point fell into a sector. */
+  bool occupied(int sector) const { return nearest_[sector] < kNoDepth; }
+  /** The depth of the nearest point of a sector, if occupied. */
+  float nearest(int sector) const { return nearest_[sector]; }
+
+  int sectorOf(double bearing) const
+  {
+    int sector = (int)floor((bearing / fov_ + 0.5) * bins_.size());
+    return std::min(std::max(sector, 0), size() - 1);
+  }
+
+  double sectorWidth() const { return fov_ / bins_.size(); }
+
+  double bearingOf(int sector) const
+  {
+    return ((sector + 0.5) / bins_.size() - 0.5) * fov_;
+  }
+
+  /*!
+   * @brief Find the free bearing closest to the target.
+   * A candidate gap is a run of at least min_width sectors whose
+   * density does not exceed the threshold. The steering bearing is
+   * the target itself if it lies far enough inside a gap, otherwise
+   * the center of the min_width sectors at the gap edge nearest to
+   * the target.
+   * @param target The bearing we would like to go.
+   * @param threshold Sectors with more density than this are blocked.
+   * @param min_width The number of free sectors the robot needs.
+   * @param bearing The chosen bearing, if any.
+   * @return false if no gap is wide enough.
+   */
+  bool steer(double target, float threshold, int min_width, double& bearing) const
+  {
+    const int n = size();
+    min_width = std::min(std::max(min_width, 1), n);
+    bool found = false;
+    double best_error = 0.0;
+
+    int start = 0;
+    while (start < n)
+    {
+      if (bins_[start] > threshold) { ++start; continue; }
+      int end = start;
+      while (end < n && bins_[end] <= threshold) ++end;
+
+      if (end - start >= min_width)
+      {
+        // Keep half the robot width of free sectors on each side.
+        double lo = bearingOf(start) + (min_width - 1) * 0.5 * fov_ / n;
+        double hi = bearingOf(end - 1) - (min_width - 1) * 0.5 * fov_ / n;
+        double candidate = std::min(std::max(target, lo), hi);
+        double error = fabs(candidate - target);
+        if (!found || error < best_error)
+        {
+          found = true;
+          best_error = error;
+          bearing = candidate;
+        }
+      }
+      start = end;
+    }
+    return found;
+  }
+
+  /** Total density to the left (negative bearings) minus to the right. */
+  float balance() const
+  {
+    float sum = 0.0f;
+    const int n = size();
+    for (int i = 0; i < n / 2; ++i)
+      sum += bins_[i] - bins_[n - 1 - i];
+    return sum;
+  }
+
+private:
+  double fov_;
+  std::vector<float> bins_;
+  std::vector<float> nearest_;
+  std::vector<int> column_sector_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_POLAR_HISTOGRAM_H
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_POSE_HISTORY_H
+#define TURTLEBOT_FOLLOWER_POSE_HISTORY_H
+
+#include <cmath>
+#include <vector>
+
+namespace turtlebot_follower
+{
+
+//* A robot pose at a point in time.
+struct StampedPose
+{
+  double stamp; /**< In s */
+  double x, y; /**< In the odometry frame, in m */
+  double yaw; /**< In rad */
+};
+
+//* The recent robot poses, to look up where the robot was when a sensor fired.
+/**
+ * A fixed size ring in time order. At the 50 Hz of the Kobuki odometry
+ * the default size covers five seconds, more than any sensor latency
+ * worth compensating.
+ */
+class PoseHistory
+{
+public:
+  explicit PoseHistory(size_t capacity = 256) : ring_(capacity), head_(0), size_(0) {}
+
+  /** Add the newest pose; poses older than the newest one are ignored. */
+  void add(double stamp, double x, double y, double yaw)
+  {
+    if (size_ > 0 && stamp <= latest().stamp)
+      return;
+    StampedPose& pose = ring_[head_];
+    pose.stamp = stamp;
+    pose.x = x;
+    pose.y = y;
+    pose.yaw = yaw;
+    head_ = (head_ + 1) % ring_.size();
+    if (size_ < ring_.size())
+      ++size_;
+  }
+
+  bool empty() const { return size_ == 0; }
+
+  const StampedPose& latest() const { return at(size_ - 1); }
+
+  /*!
+   * @brief Interpolate the pose at a time.
+   * Times after the newest pose give the newest pose.
+   * @return false if the history is empty or does not reach back that far.
+   */
+  bool poseAt(double stamp, StampedPose& pose) const
+  {
+    if (size_ == 0 || stamp < at(0).stamp)
+      return false;
+    if (stamp >= latest().stamp)
+    {
+      pose = latest();
+      return true;
+    }
+
+    // The first pose after the stamp
+    size_t lo = 0, hi = size_ - 1;
+    while (lo + 1 < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      if (at(mid).stamp <= stamp)
+        lo = mid;
+      else
+        hi = mid;
+    }
+    const StampedPose& a = at(lo);
+    const StampedPose& b = at(hi);
+    const double t = (stamp - a.stamp) / (b.stamp - a.stamp);
+    pose.stamp = stamp;
+    pose.x = a.x + t * (b.x - a.x);
+    pose.y = a.y + t * (b.y - a.y);
+    pose.yaw = a.yaw + t * remainder(b.yaw - a.yaw, 2.0 * M_PI);
+    return true;
+  }
+
+  /*!
+   * @brief How far the robot has turned since a time, positive to the left.
+   * @return false if the history does not reach back that far.
+   */
+  bool yawSince(double stamp, double& change) const
+  {
+    StampedPose then;
+    if (!poseAt(stamp, then))
+      return false;
+    change = remainder(latest().yaw - then.yaw, 2.0 * M_PI);
+    return true;
+  }
+
+private:
+  /** The i-th oldest pose. */
+  const StampedPose& at(size_t i) const
+  {
+    return ring_[(head_ + ring_.size() - size_ + i) % ring_.size()];
+  }
+
+  std::vector<StampedPose> ring_;
+  size_t head_; /**< Where the next pose goes */
+  size_t size_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_POSE_HISTORY_H
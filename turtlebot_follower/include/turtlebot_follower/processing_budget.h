@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_PROCESSING_BUDGET_H
+#define TURTLEBOT_FOLLOWER_PROCESSING_BUDGET_H
+
+#include <algorithm>
+
+namespace turtlebot_follower
+{
+
+//* Self-tuning quality level for the depth callback.
+/**
+ * Keeps the cost of the obstacle pass inside a latency budget by
+ * trading resolution for time. Each quality level decimates the
+ * depth image by a pixel stride and may skip frames entirely; the
+ * level goes up as soon as the smoothed cost exceeds the budget and
+ * comes back down once the cost of the finer level is predicted to
+ * fit comfortably. Frames are never skipped for longer than the
+ * minimum decision rate allows.
+ *
+ * A budget of zero disables the tuning and processes every pixel of
+ * every frame.
+ *
+ * Independently of the budget, the frame rate can be capped while the
+ * follower needs fewer decisions.
+ */
+class ProcessingBudget
+{
+public:
+  ProcessingBudget() : budget_(0.0), min_period_(0.1), max_period_(0.0), level_(0),
+                       cost_(0.0), last_decision_(0.0), skipped_(0),
+                       settle_frames_(0), calm_frames_(0), missed_(0)
+  {
+  }
+
+  /*!
+   * @brief Set the budget.
+   * @param budget The latency budget of one frame in seconds, or 0.
+   * @param min_rate The minimum rate of obstacle decisions in Hz.
+   */
+  void configure(double budget, double min_rate)
+  {
+    budget_ = budget;
+    min_period_ = min_rate > 0.0 ? 1.0 / min_rate : 0.0;
+    if (budget_ <= 0.0)
+      level_ = 0;
+  }
+
+  bool enabled() const { return budget_ > 0.0; }
+
+  /*!
+   * @brief Cap the rate of processed frames.
+   * @param rate The most frames per second to process, or 0 for all.
+   */
+  void setMaxRate(double rate)
+  {
+    max_period_ = rate > 0.0 ? 1.0 / rate : 0.0;
+  }
+
+  /*!
+   * @brief Whether the frame taken at the given time should be processed.
+   * Skips frames as the quality level asks, unless the last decision is
+   * older than the minimum decision period, and frames beyond the rate cap.
+   */
+  bool admit(double stamp)
+  {
+    // Some slack, so that jitter does not cost a whole extra frame period
+    if (stamp - last_decision_ < 0.9 * max_period_ && stamp >= last_decision_)
+    {
+      ++skipped_;
+      return false;
+    }
+    if (skipped_ >= skip() ||
+        stamp - last_decision_ >= min_period_ || stamp < last_decision_)
+    {
+      skipped_ = 0;
+      last_decision_ = stamp;
+      return true;
+    }
+    ++skipped_;
+    return false;
+  }
+
+  /*!
+   * @brief Account for the cost of a processed frame and retune.
+   * @param cost The time spent on the frame in seconds.
+   */
+  void record(double cost)
+  {
+    if (!enabled())
+      return;
+
+    const double smoothing = 0.2;
+    const double headroom = 0.7;
+
+    cost_ = cost_ == 0.0 ? cost : cost_ + smoothing * (cost - cost_);
+    if (cost > budget_)
+      ++missed_;
+
+    // Give each new level a few frames to show its cost
+    if (settle_frames_ > 0)
+    {
+      --settle_frames_;
+      return;
+    }
+
+    if (cost_ > budget_ && level_ + 1 < kNumLevels)
+    {
+      // Predict the cost of the coarser level so one slow frame does not
+      // skip several levels at once.
+      ++level_;
+      cost_ *= ratio(level_ - 1, level_);
+      settle_frames_ = kSettleFrames;
+      calm_frames_ = 0;
+    }
+    else if (level_ > 0 && cost_ * ratio(level_, level_ - 1) < headroom * budget_)
+    {
+      if (++calm_frames_ >= kCalmFrames)
+      {
+        --level_;
+        cost_ *= ratio(level_ + 1, level_);
+        settle_frames_ = kSettleFrames;
+        calm_frames_ = 0;
+      }
+    }
+    else
+    {
+      calm_frames_ = 0;
+    }
+  }
+
+  int level() const { return level_; }
+  /** The pixel stride of the current quality level. */
+  int stride() const { return levelAt(level_).stride; }
+  /** The number of frames skipped between processed ones. */
+  int skip() const { return levelAt(level_).skip; }
+  /** The smoothed cost of a processed frame in seconds. */
+  double cost() const { return cost_; }
+  /** The number of processed frames that took longer than the budget. */
+  unsigned int missedDeadlines() const { return missed_; }
+
+private:
+  struct Level
+  {
+    int stride;
+    int skip;
+  };
+
+  enum { kNumLevels = 6, kSettleFrames = 5, kCalmFrames = 30 };
+
+  static const Level& levelAt(int level)
+  {
+    static const Level levels[kNumLevels] =
+    {
+      {1, 0}, {2, 0}, {4, 0}, {4, 1}, {8, 1}, {8, 2}
+    };
+    return levels[level];
+  }
+
+  /** Expected cost of a frame at level `to`, relative to level `from`. */
+  static double ratio(int from, int to)
+  {
+    double s = (double)levelAt(from).stride / levelAt(to).stride;
+    return s * s;
+  }
+
+  double budget_;
+  double min_period_;
+  double max_period_; /**< The shortest time between processed frames, 0 for none */
+  int level_;
+  double cost_;
+  double last_decision_;
+  int skipped_;
+  int settle_frames_;
+  int calm_frames_;
+  unsigned int missed_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_PROCESSING_BUDGET_H
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_RAY_TABLE_H
+#define TURTLEBOT_FOLLOWER_RAY_TABLE_H
+
+#include <cmath>
+#include <stdint.h>
+#include <vector>
+
+namespace turtlebot_follower
+{
+
+/** Horizontal field of view of the 3d sensor, in radians. */
+const double kHorizontalFov = 60.0 / 57.0;
+/** Vertical field of view of the 3d sensor, in radians. */
+const double kVerticalFov = 45.0 / 57.0;
+
+//* Per-pixel ray directions of the depth camera.
+/**
+ * Caches the sin/cos of the bearing of every image column and the
+ * elevation of every image row, so the depth callbacks do not have
+ * to recompute them for each frame. The tables are only rebuilt
+ * when the image resolution changes.
+ */
+class RayTable
+{
+public:
+  RayTable() : width_(0), height_(0) {}
+
+  /*!
+   * @brief Rebuild the tables for a new resolution.
+   * Does nothing if the resolution did not change.
+   * @return true if the tables were rebuilt.
+   */
+  bool resize(uint32_t width, uint32_t height)
+  {
+    if (width == width_ && height == height_)
+      return false;
+
+    width_ = width;
+    height_ = height;
+
+    float x_radians_per_pixel = kHorizontalFov / width;
+    bearing_.resize(width);
+    sin_x_.resize(width);
+    cos_x_.resize(width);
+    for (uint32_t u = 0; u < width; ++u)
+    {
+      bearing_[u] = (u - width / 2.0) * x_radians_per_pixel;
+      sin_x_[u] = sin(bearing_[u]);
+      cos_x_[u] = cos(bearing_[u]);
+    }
+
+    float y_radians_per_pixel = kVerticalFov / height;
+    sin_y_.resize(height);
+    for (uint32_t v = 0; v < height; ++v)
+    {
+      // Sign opposite x for y up values
+      sin_y_[v] = sin((height / 2.0 - v) * y_radians_per_pixel);
+    }
+    return true;
+  }
+
+  uint32_t width() const { return width_; }
+  uint32_t height() const { return height_; }
+
+  /** Bearing of column u in radians, positive to the right of the image. */
+  const std::vector<float>& bearing() const { return bearing_; }
+  const std::vector<float>& sinX() const { return sin_x_; }
+  const std::vector<float>& cosX() const { return cos_x_; }
+  const std::vector<float>& sinY() const { return sin_y_; }
+
+  /** The frontal area one pixel covers at 1 m depth, in m^2; it grows with the depth squared. */
+  float footprint() const { return (kHorizontalFov / width_) * (kVerticalFov / height_); }
+
+private:
+  uint32_t width_;
+  uint32_t height_;
+  std::vector<float> bearing_;
+  std::vector<float> sin_x_;
+  std::vector<float> cos_x_;
+  std::vector<float> sin_y_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_RAY_TABLE_H
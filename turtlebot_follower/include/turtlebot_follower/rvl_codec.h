@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_RVL_CODEC_H
+#define TURTLEBOT_FOLLOWER_RVL_CODEC_H
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+
+namespace turtlebot_follower
+{
+
+/** The sensor_msgs/CompressedImage format of RVL depth images. */
+const char* const kRvlFormat = "rvl";
+
+//* RVL lossless compression of depth images.
+/**
+ * Run length, variable length coding of 16 bit millimeter depth
+ * (Wilson, "Fast Lossless Depth Image Compression", 2017). Pixels are
+ * coded in raster order as alternating runs of missing (0) and valid
+ * depth, and every valid depth as the zigzag coded difference to the
+ * previous valid one. Run lengths and differences go out in groups of
+ * 3 bits with a continuation bit, eight of these nibbles to a 32 bit
+ * word. Smooth surfaces take about a nibble per pixel, and a VGA frame
+ * codes in a millisecond or two either way.
+ *
+ * A compressed image is an 8 byte header with the width and the height
+ * followed by the words, all little endian.
+ */
+class RvlEncoder
+{
+public:
+  /*!
+   * @brief Compress a depth image.
+   * @param depth The first pixel, uint16_t millimeters or float meters.
+   * @param row_step The distance between image rows, in elements.
+   * @param width The image width.
+   * @param height The image height.
+   * @param out The compressed image; only its size is changed.
+   */
+  template<typename T>
+  void encode(const T* depth, int row_step, uint32_t width, uint32_t height, std::vector<uint8_t>& out)
+  {
+    const size_t pixels = (size_t)width * height;
+    // One spare pixel, so that even an empty image has a first one
+    packed_.resize(pixels + 1);
+    for (uint32_t v = 0; v < height; ++v, depth += row_step)
+      packRow(depth, width, &packed_[v * width]);
+
+    // A valid pixel takes at most 6 nibbles, a run length at most as many as its pixels
+    words_.resize(2 + pixels + 4);
+    words_[0] = width;
+    words_[1] = height;
+    word_ = &words_[2];
+    nibbles_ = 0;
+    bits_ = 0;
+
+    const uint16_t* p = &packed_[0];
+    const uint16_t* end = p + pixels;
+    int previous = 0;
+    while (p < end)
+    {
+      const uint16_t* run = p;
+      while (p < end && *p == 0)
+        ++p;
+      put(p - run);
+      run = p;
+      while (p < end && *p != 0)
+        ++p;
+      put(p - run);
+      for (; run < p; ++run)
+      {
+        const int delta = *run - previous;
+        put(((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+        previous = *run;
+      }
+    }
+    if (nibbles_ > 0)
+      *word_++ = bits_ << (4 * (8 - nibbles_));
+
+    const size_t bytes = (word_ - &words_[0]) * sizeof(uint32_t);
+    out.resize(bytes);
+    memcpy(&out[0], &words_[0], bytes);
+  }
+
+private:
+  static void packRow(const uint16_t* row, uint32_t width, uint16_t* out)
+  {
+    memcpy(out, row, width * sizeof(uint16_t));
+  }
+
+  static void packRow(const float* row, uint32_t width, uint16_t* out)
+  {
+    // NaN fails the comparison
+    for (uint32_t u = 0; u < width; ++u)
+      out[u] = row[u] > 0.0f && row[u] < 65.535f ? (uint16_t)(row[u] * 1000.0f + 0.5f) : 0;
+  }
+
+  /** Write a value in 3 bit groups, lowest first, each flagged if more follow. */
+  void put(uint32_t value)
+  {
+    do
+    {
+      uint32_t nibble = value & 7;
+      value >>= 3;
+      if (value)
+        nibble |= 8;
+      bits_ = (bits_ << 4) | nibble;
+      if (++nibbles_ == 8)
+      {
+        *word_++ = bits_;
+        nibbles_ = 0;
+        bits_ = 0;
+      }
+    } while (value);
+  }
+
+  std::vector<uint16_t> packed_; /**< The image without row padding, in millimeters */
+  std::vector<uint32_t> words_; /**< The header and the code words */
+  uint32_t* word_; /**< The next word to write */
+  int nibbles_; /**< The nibbles in bits_ */
+  uint32_t bits_; /**< The nibbles of the word being filled */
+};
+
+//* Decompression of RVL depth images into a buffer reused across frames.
+class RvlDecoder
+{
+public:
+  enum
+  {
+    kMaxPixels = 1 << 24 /**< Larger images are taken for corrupt headers */
+  };
+
+  RvlDecoder() : width_(0), height_(0) {}
+
+  /*!
+   * @brief Read the image size of a compressed image without decoding it.
+   * @return false if the data is too short for the header or not
+   * whole words, or the image is empty or larger than kMaxPixels.
+   */
+  static bool peek(const std::vector<uint8_t>& data, uint32_t& width, uint32_t& height)
+  {
+    if (data.size() < 2 * sizeof(uint32_t) || (data.size() & 3) != 0)
+      return false;
+    memcpy(&width, &data[0], sizeof(uint32_t));
+    memcpy(&height, &data[sizeof(uint32_t)], sizeof(uint32_t));
+    const uint64_t pixels = (uint64_t)width * height;
+    return pixels != 0 && pixels <= kMaxPixels;
+  }
+
+  /*!
+   * @brief Decode a compressed image into depth().
+   * The buffer is only reallocated when the image size grows.
+   * @return false if the data is truncated or corrupt.
+   */
+  bool decode(const std::vector<uint8_t>& data)
+  {
+    if (!peek(data, width_, height_))
+      return false;
+    const size_t pixels = (size_t)width_ * height_;
+    depth_.resize(pixels);
+    words_.resize(data.size() / sizeof(uint32_t));
+    memcpy(&words_[0], &data[0], data.size());
+    word_ = &words_[2];
+    end_ = &words_[0] + words_.size();
+    nibbles_ = 0;
+    bits_ = 0;
+    ok_ = true;
+
+    uint16_t* p = &depth_[0];
+    uint16_t* end = p + pixels;
+    // Wraps rather than overflows on corrupt deltas, which then fail the
+    // range check: the encoder's deltas never leave 16 bits
+    uint32_t previous = 0;
+    while (p < end && ok_)
+    {
+      uint32_t zeros = get();
+      uint32_t valid = get();
+      if (zeros > (size_t)(end - p) || valid > (size_t)(end - p) - zeros)
+        return false;
+      memset(p, 0, zeros * sizeof(uint16_t));
+      p += zeros;
+      for (uint16_t* run_end = p + valid; p < run_end; ++p)
+      {
+        const uint32_t positive = get();
+        previous += (positive >> 1) ^ (0u - (positive & 1));
+        if (previous > 0xffff)
+          return false;
+        *p = (uint16_t)previous;
+      }
+    }
+    return ok_;
+  }
+
+  uint32_t width() const { return width_; }
+  uint32_t height() const { return height_; }
+  /** The depth of the last decoded image, in millimeters, rows without padding. */
+  const uint16_t* depth() const { return depth_.empty() ? NULL : &depth_[0]; }
+
+private:
+  /** Read a value written by RvlEncoder::put(). */
+  uint32_t get()
+  {
+    uint32_t value = 0;
+    int shift = 0;
+    uint32_t nibble;
+    do
+    {
+      if (shift > 30 || (nibbles_ == 0 && word_ == end_))
+      {
+        ok_ = false;
+        return 0;
+      }
+      if (nibbles_ == 0)
+      {
+        bits_ = *word_++;
+        nibbles_ = 8;
+      }
+      nibble = bits_ >> 28;
+      bits_ <<= 4;
+      --nibbles_;
+      value |= (nibble & 7) << shift;
+      shift += 3;
+    } while (nibble & 8);
+    return value;
+  }
+
+  uint32_t width_, height_;
+  std::vector<uint16_t> depth_; /**< The decoded image, reused across frames */
+  std::vector<uint32_t> words_; /**< The code words, aligned */
+  const uint32_t* word_; /**< The next word to read */
+  const uint32_t* end_;
+  int nibbles_; /**< The nibbles left in bits_ */
+  uint32_t bits_; /**< The rest of the word being read, next nibble on top */
+  bool ok_; /**< Whether the data has been well formed so far */
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_RVL_CODEC_H
@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_SEARCH_PLANNER_H
+#define TURTLEBOT_FOLLOWER_SEARCH_PLANNER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <stdint.h>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/noncopyable.hpp>
+#include "turtlebot_follower/ray_table.h"
+
+namespace turtlebot_follower
+{
+
+/** The typical width of a face, in m; ranges a face from its width in the image. */
+const double kFaceWidth = 0.16;
+
+/** The geometry of a square grid centered on the odometry origin. */
+struct GridGeometry
+{
+  GridGeometry(int cells = 64, float resolution = 0.5f) : cells(cells), resolution(resolution) {}
+
+  int cells; /**< Cells per side */
+  float resolution; /**< Cell size, in m */
+
+  /** The index of the cell holding (x, y), or -1 outside the grid. */
+  int index(double x, double y) const
+  {
+    int i = (int)floor(x / resolution + cells / 2);
+    int j = (int)floor(y / resolution + cells / 2);
+    if (i < 0 || j < 0 || i >= cells || j >= cells)
+      return -1;
+    return j * cells + i;
+  }
+
+  int size() const { return cells * cells; }
+};
+
+//* Which parts of the odometry frame the camera has looked at.
+/**
+ * One saturating counter per cell; the cells in view up to a few meters
+ * ahead are counted every time the robot has moved or turned a bit.
+ * Counters are halved every now and then, so that the robot eventually
+ * comes back to places it searched long ago.
+ */
+class VisitedGrid
+{
+public:
+  explicit VisitedGrid(const GridGeometry& geometry = GridGeometry())
+    : geometry_(geometry), cells_(geometry.size(), 0), marked_(false),
+      last_x_(0.0), last_y_(0.0), last_yaw_(0.0)
+  {
+  }
+
+  const GridGeometry& geometry() const { return geometry_; }
+
+  /*!
+   * @brief Count the cells in the camera view from a pose.
+   * Does nothing until the robot moved 10 cm or turned 0.2 rad.
+   */
+  void mark(double x, double y, double yaw, double range = 2.0)
+  {
+    if (marked_ && hypot(x - last_x_, y - last_y_) < 0.1 &&
+        fabs(remainder(yaw - last_yaw_, 2.0 * M_PI)) < 0.2)
+      return;
+    marked_ = true;
+    last_x_ = x;
+    last_y_ = y;
+    last_yaw_ = yaw;
+
+    // Count every cell once per view, however many rays cross it
+    std::vector<int> seen;
+    const int rays = 7;
+    for (int k = 0; k < rays; ++k)
+    {
+      double angle = yaw + (k / (rays - 1.0) - 0.5) * kHorizontalFov;
+      for (double r = 0.0; r <= range; r += geometry_.resolution * 0.5)
+      {
+        int i = geometry_.index(x + r * cos(angle), y + r * sin(angle));
+        if (i >= 0 && std::find(seen.begin(), seen.end(), i) == seen.end())
+          seen.push_back(i);
+      }
+    }
+    for (size_t k = 0; k < seen.size(); ++k)
+      if (cells_[seen[k]] < 255)
+        ++cells_[seen[k]];
+  }
+
+  /** Halve all counters. */
+  void decay()
+  {
+    for (size_t i = 0; i < cells_.size(); ++i)
+      cells_[i] >>= 1;
+  }
+
+  /** How often the cell at (x, y) was seen; outside the grid counts as seen a lot. */
+  int visits(double x, double y) const
+  {
+    int i = geometry_.index(x, y);
+    return i < 0 ? 255 : cells_[i];
+  }
+
+private:
+  GridGeometry geometry_;
+  std::vector<uint8_t> cells_;
+  bool marked_;
+  double last_x_, last_y_, last_yaw_;
+};
+
+//* Where faces have been seen before, kept across runs.
+/**
+ * A grid of sighting weights in the odometry frame, memory mapped from
+ * a file so that it survives restarts without any explicit load or
+ * save; the kernel writes it back. The odometry frame starts wherever
+ * the robot boots, so the map is only meaningful if the robot is
+ * always started from the same spot, as on its dock.
+ *
+ * Without a file, or if the file cannot be mapped, the map lives in
+ * memory for this run only.
+ */
+class SightingHeatmap : boost::noncopyable
+{
+public:
+  explicit SightingHeatmap(const GridGeometry& geometry = GridGeometry())
+    : geometry_(geometry), header_(NULL), cells_(NULL), map_size_(0)
+  {
+    memory_.assign(geometry.size(), 0.0f);
+    cells_ = &memory_[0];
+  }
+
+  ~SightingHeatmap() { close(); }
+
+  /*!
+   * @brief Map the heatmap file, creating it if needed.
+   * A file of another geometry is started over.
+   * @return false if the file could not be mapped.
+   */
+  bool open(const std::string& path)
+  {
+    close();
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+      return false;
+    const size_t size = sizeof(Header) + geometry_.size() * sizeof(float);
+    struct stat st;
+    bool fresh = fstat(fd, &st) != 0 || (size_t)st.st_size != size;
+    if (fresh && ftruncate(fd, size) != 0)
+    {
+      ::close(fd);
+      return false;
+    }
+    void* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED)
+      return false;
+
+    map_size_ = size;
+    header_ = static_cast<Header*>(map);
+    cells_ = reinterpret_cast<float*>(header_ + 1);
+    if (fresh || memcmp(header_->magic, magic(), sizeof(header_->magic)) != 0 ||
+        header_->cells != (uint32_t)geometry_.cells || header_->resolution != geometry_.resolution)
+    {
+      memcpy(header_->magic, magic(), sizeof(header_->magic));
+      header_->cells = geometry_.cells;
+      header_->resolution = geometry_.resolution;
+      std::fill(cells_, cells_ + geometry_.size(), 0.0f);
+    }
+    return true;
+  }
+
+  void close()
+  {
+    if (!header_)
+      return;
+    munmap(header_, map_size_);
+    header_ = NULL;
+    cells_ = &memory_[0];
+  }
+
+  bool mapped() const { return header_ != NULL; }
+
+  /** Add a sighting at (x, y); weights saturate so old hot spots can cool down. */
+  void addSighting(double x, double y, float weight = 1.0f)
+  {
+    int i = geometry_.index(x, y);
+    if (i >= 0)
+      cells_[i] = std::min(cells_[i] + weight, 100.0f);
+  }
+
+  /** Scale all weights, forgetting old sightings. */
+  void decay(float factor)
+  {
+    for (int i = 0; i < geometry_.size(); ++i)
+      cells_[i] *= factor;
+  }
+
+  float weight(double x, double y) const
+  {
+    int i = geometry_.index(x, y);
+    return i < 0 ? 0.0f : cells_[i];
+  }
+
+private:
+  struct Header
+  {
+    char magic[8];
+    uint32_t cells;
+    float resolution;
+  };
+
+  static const char* magic() { return "FOLHEAT1"; }
+
+  GridGeometry geometry_;
+  std::vector<float> memory_;
+  Header* header_;
+  float* cells_;
+  size_t map_size_;
+};
+
+//* Picks the heading to search in.
+/**
+ * Scores a fan of candidate headings by how little the cells along
+ * them have been looked at and how many faces were seen there before,
+ * and keeps the chosen heading for a while to avoid dithering.
+ */
+class SearchPlanner
+{
+public:
+  SearchPlanner() : heading_(0.0), valid_(false), chosen_at_(0.0) {}
+
+  /*!
+   * @brief Choose the heading to search in.
+   * @param now The current time, in s.
+   * @param x The robot position in the odometry frame.
+   * @param y The robot position in the odometry frame.
+   * @param yaw The robot heading.
+   * @param visited The explored cells.
+   * @param heatmap The previous sightings.
+   * @param heatmap_weight The value of a sighting relative to an unexplored cell.
+   * @return The heading, in the odometry frame.
+   */
+  double plan(double now, double x, double y, double yaw, const VisitedGrid& visited,
+              const SightingHeatmap& heatmap, double heatmap_weight)
+  {
+    // Stick to a heading for a few seconds unless it is reached
+    if (valid_ && now - chosen_at_ < 5.0 && now >= chosen_at_ &&
+        fabs(remainder(heading_ - yaw, 2.0 * M_PI)) > 0.1)
+      return heading_;
+
+    const int candidates = 16;
+    double best_score = -1.0;
+    for (int k = 0; k < candidates; ++k)
+    {
+      double heading = yaw + k * 2.0 * M_PI / candidates;
+      double score = 0.0;
+      for (double r = 0.5; r <= 3.0; r += 0.5)
+      {
+        double px = x + r * cos(heading), py = y + r * sin(heading);
+        score += 1.0 / (1.0 + visited.visits(px, py));
+        score += heatmap_weight * heatmap.weight(px, py) / (1.0 + heatmap.weight(px, py));
+      }
+      // Turning costs time
+      score *= 1.0 - 0.25 * fabs(remainder(heading - yaw, 2.0 * M_PI)) / M_PI;
+      if (score > best_score)
+      {
+        best_score = score;
+        heading_ = heading;
+      }
+    }
+    valid_ = true;
+    chosen_at_ = now;
+    return heading_;
+  }
+
+private:
+  double heading_;
+  bool valid_;
+  double chosen_at_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_SEARCH_PLANNER_H
@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_STALENESS_WATCHDOG_H
+#define TURTLEBOT_FOLLOWER_STALENESS_WATCHDOG_H
+
+#include <string>
+#include <vector>
+
+namespace turtlebot_follower
+{
+
+//* Tracks the age of the follower's inputs against latency SLOs.
+/**
+ * Every input has two age limits: past the slow age the robot should
+ * slow down, past the stop age it should stop. The age of an input is
+ * measured from the header stamp of its latest message, so both a
+ * stalled stream and a stream arriving late count against the SLO.
+ * Inputs recover as soon as a fresh message arrives.
+ *
+ * Times are in seconds; the watchdog itself does not read any clock.
+ */
+class StalenessWatchdog
+{
+public:
+  enum Health
+  {
+    FRESH = 0, /**< Within the SLO */
+    SLOW = 1,  /**< Past the slow age */
+    STALE = 2  /**< Past the stop age */
+  };
+
+  /*!
+   * @brief Register an input.
+   * @param name The name for diagnostics.
+   * @param slow_age The age past which the robot should slow down.
+   * @param stop_age The age past which the robot should stop.
+   * @return The id of the input.
+   */
+  int addInput(const std::string& name, double slow_age, double stop_age)
+  {
+    Input input;
+    input.name = name;
+    input.slow_age = slow_age;
+    input.stop_age = stop_age;
+    inputs_.push_back(input);
+    return inputs_.size() - 1;
+  }
+
+  void setLimits(int id, double slow_age, double stop_age)
+  {
+    inputs_[id].slow_age = slow_age;
+    inputs_[id].stop_age = stop_age;
+  }
+
+  /*!
+   * @brief Record a message of an input.
+   * @param id The input.
+   * @param stamp The header stamp of the message, or its arrival time
+   *              if the message has no stamp.
+   */
+  void touch(int id, double stamp)
+  {
+    Input& input = inputs_[id];
+    if (!input.seen || stamp > input.stamp)
+      input.stamp = stamp;
+    input.seen = true;
+  }
+
+  /*!
+   * @brief Re-evaluate the health of every input.
+   * Counts a violation every time an input falls from one level to a
+   * worse one.
+   * @param now The current time.
+   * @return The worst health of all inputs.
+   */
+  Health check(double now)
+  {
+    Health worst = FRESH;
+    for (size_t i = 0; i < inputs_.size(); ++i)
+    {
+      Input& input = inputs_[i];
+      double age = input.seen ? now - input.stamp : input.stop_age + 1.0;
+      Health health = age > input.stop_age ? STALE : age > input.slow_age ? SLOW : FRESH;
+      if (health > input.health)
+      {
+        if (health >= SLOW && input.health < SLOW)
+          ++input.slow_violations;
+        if (health == STALE)
+          ++input.stop_violations;
+      }
+      input.health = health;
+      input.age = age;
+      if (health > worst)
+        worst = health;
+    }
+    return worst;
+  }
+
+  size_t size() const { return inputs_.size(); }
+  const std::string& name(int id) const { return inputs_[id].name; }
+  Health health(int id) const { return inputs_[id].health; }
+  /** The age of an input at the last check. */
+  double age(int id) const { return inputs_[id].age; }
+  /** How often the input went past its slow age. */
+  unsigned int slowViolations(int id) const { return inputs_[id].slow_violations; }
+  /** How often the input went past its stop age. */
+  unsigned int stopViolations(int id) const { return inputs_[id].stop_violations; }
+
+private:
+  struct Input
+  {
+    Input() : slow_age(0.0), stop_age(0.0), seen(false), stamp(0.0), age(0.0),
+              health(STALE), slow_violations(0), stop_violations(0) {}
+    std::string name;
+    double slow_age;
+    double stop_age;
+    bool seen;
+    double stamp;
+    double age;
+    Health health;
+    unsigned int slow_violations;
+    unsigned int stop_violations;
+  };
+
+  std::vector<Input> inputs_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_STALENESS_WATCHDOG_H
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef TURTLEBOT_FOLLOWER_TEMPLATE_TRACKER_H
+#define TURTLEBOT_FOLLOWER_TEMPLATE_TRACKER_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include <sensor_msgs/Image.h>
+#include "turtlebot_follower/image_roi.h"
+
+namespace turtlebot_follower
+{
+
+/*!
+ * @brief Sample a grayscale patch out of an 8 bit image.
+ * Each patch pixel is the mean over all channels of a scale x scale
+ * block; blocks outside the image read as the nearest edge pixel.
+ * @param image The image.
+ * @param x The left edge of the patch, in image pixels.
+ * @param y The top edge of the patch, in image pixels.
+ * @param width The patch width, in patch pixels.
+ * @param height The patch height, in patch pixels.
+ * @param scale The size of a patch pixel, in image pixels.
+ * @param patch The patch, row major.
+ * @return false if the encoding is not 8 bit per channel.
+ */
+inline bool sampleGray(const sensor_msgs::Image& image, int x, int y, int width, int height,
+                       int scale, std::vector<float>& patch)
+{
+  const int channels = byteChannels(image.encoding);
+  if (channels == 0 || image.width == 0 || image.height == 0)
+    return false;
+
+  patch.resize(width * height);
+  const float norm = 1.0f / (scale * scale * channels);
+  for (int v = 0; v < height; ++v)
+  {
+    for (int u = 0; u < width; ++u)
+    {
+      unsigned int sum = 0;
+      for (int dy = 0; dy < scale; ++dy)
+      {
+        int row = std::min(std::max(y + v * scale + dy, 0), (int)image.height - 1);
+        const uint8_t* src = &image.data[row * image.step];
+        for (int dx = 0; dx < scale; ++dx)
+        {
+          int col = std::min(std::max(x + u * scale + dx, 0), (int)image.width - 1);
+          for (int c = 0; c < channels; ++c)
+            sum += src[col * channels + c];
+        }
+      }
+      patch[v * width + u] = sum * norm;
+    }
+  }
+  return true;
+}
+
+//* A small grayscale template tracker.
+/**
+ * Tracks a face between detector runs by normalized cross correlation
+ * of a template x template grayscale patch, sampled at the scale of
+ * the face, over a small search window around the predicted position.
+ * The correlation peak doubles as the tracking confidence.
+ */
+class TemplateTracker
+{
+public:
+  TemplateTracker() : size_(24), radius_(8), scale_(1), valid_(false), confidence_(0.0) {}
+
+  /*!
+   * @brief Set the template size and search radius, in template pixels.
+   */
+  void configure(int size, int radius)
+  {
+    size_ = std::max(size, 4);
+    radius_ = std::max(radius, 1);
+    valid_ = false;
+  }
+
+  /*!
+   * @brief Take a new template around a detected face.
+   * @param image The image the face was detected in.
+   * @param cx The center of the face, in pixels.
+   * @param cy
+   * @param face_size The size of the face, in pixels.
+   */
+  bool init(const sensor_msgs::Image& image, double cx, double cy, double face_size)
+  {
+    scale_ = std::max(1, (int)(face_size / size_ + 0.5));
+    int half = size_ * scale_ / 2;
+    if (!sampleGray(image, (int)cx - half, (int)cy - half, size_, size_, scale_, template_))
+      return false;
+    valid_ = normalize(template_.begin(), template_.end(), template_);
+    confidence_ = valid_ ? 1.0 : 0.0;
+    return valid_;
+  }
+
+  /*!
+   * @brief Find the template near a predicted position.
+   * @param image The new image.
+   * @param cx The predicted center on input, the tracked center on output.
+   * @param cy
+   * @return The correlation peak, in [-1, 1].
+   */
+  double track(const sensor_msgs::Image& image, double& cx, double& cy)
+  {
+    if (!valid_)
+      return confidence_ = 0.0;
+
+    const int window = size_ + 2 * radius_;
+    int half = window * scale_ / 2;
+    int x0 = (int)cx - half;
+    int y0 = (int)cy - half;
+    if (!sampleGray(image, x0, y0, window, window, scale_, window_))
+      return confidence_ = 0.0;
+
+    double best = -2.0;
+    int best_u = radius_;
+    int best_v = radius_;
+    std::vector<float>& patch = scratch_;
+    patch.resize(size_ * size_);
+    for (int v = 0; v <= 2 * radius_; ++v)
+    {
+      for (int u = 0; u <= 2 * radius_; ++u)
+      {
+        for (int r = 0; r < size_; ++r)
+        {
+          const float* src = &window_[(v + r) * window + u];
+          std::copy(src, src + size_, patch.begin() + r * size_);
+        }
+        if (!normalize(patch.begin(), patch.end(), patch))
+          continue;
+        double score = 0.0;
+        for (int i = 0; i < size_ * size_; ++i)
+          score += patch[i] * template_[i];
+        if (score > best)
+        {
+          best = score;
+          best_u = u;
+          best_v = v;
+        }
+      }
+    }
+
+    cx = x0 + (best_u + size_ / 2.0) * scale_;
+    cy = y0 + (best_v + size_ / 2.0) * scale_;
+    return confidence_ = std::max(best, 0.0);
+  }
+
+  bool valid() const { return valid_; }
+  double confidence() const { return confidence_; }
+  void reset() { valid_ = false; confidence_ = 0.0; }
+
+private:
+  /** Make the patch zero mean and unit norm; false if it is flat. */
+  template<typename It>
+  static bool normalize(It begin, It end, std::vector<float>& out)
+  {
+    const size_t n = end - begin;
+    double mean = 0.0;
+    for (It it = begin; it != end; ++it)
+      mean += *it;
+    mean /= n;
+    double norm = 0.0;
+    for (size_t i = 0; i < n; ++i)
+    {
+      out[i] = begin[i] - mean;
+      norm += out[i] * out[i];
+    }
+    if (norm < 1e-6)
+      return false;
+    float inv = 1.0 / sqrt(norm);
+    for (size_t i = 0; i < n; ++i)
+      out[i] *= inv;
+    return true;
+  }
+
+  int size_;
+  int radius_;
+  int scale_;
+  bool valid_;
+  double confidence_;
+  std::vector<float> template_;
+  std::vector<float> window_;
+  std::vector<float> scratch_;
+};
+
+} // namespace turtlebot_follower
+
+#endif // TURTLEBOT_FOLLOWER_TEMPLATE_TRACKER_H
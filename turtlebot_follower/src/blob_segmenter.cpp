@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ros/ros.h>
+#include <pluginlib/class_list_macros.h>
+#include <nodelet/nodelet.h>
+#include <sensor_msgs/Image.h>
+#include <cmvision/Blob.h>
+#include <cmvision/Blobs.h>
+#include "turtlebot_follower/color_blobs.h"
+
+namespace turtlebot_follower
+{
+
+//* Color blob segmentation inside the camera's nodelet manager.
+/**
+ * Finds the regions of each configured color class in the camera
+ * images and publishes them as cmvision blobs, without the round trip
+ * of full frames through an external cmvision node. The classes come
+ * from the colors parameter, a list of names, each with a yuv array
+ * (y_min, y_max, u_min, u_max, v_min, v_max) and an rgb array for
+ * drawing; by default a single yellow class.
+ */
+class BlobSegmenter : public nodelet::Nodelet
+{
+public:
+  BlobSegmenter() : min_area_(100) {}
+
+private:
+  int min_area_; /**< The smallest blob published, in pixels */
+  BlobFinder finder_;
+  std::vector<ColorBlob> blobs_;
+
+  virtual void onInit()
+  {
+    ros::NodeHandle& private_nh = getPrivateNodeHandle();
+
+    private_nh.getParam("min_area", min_area_);
+    int decimation = 1;
+    private_nh.getParam("decimation", decimation);
+    finder_.setDecimation(decimation);
+
+    std::vector<std::string> names;
+    private_nh.getParam("colors", names);
+    if (names.empty())
+      names.push_back("yellow");
+    std::vector<ColorClass> classes;
+    for (size_t i = 0; i < names.size(); ++i)
+    {
+      ros::NodeHandle color_nh(private_nh, names[i]);
+      std::vector<int> yuv, rgb;
+      color_nh.getParam("yuv", yuv);
+      color_nh.getParam("rgb", rgb);
+      if (yuv.empty() && names[i] == "yellow")
+      {
+        static const int yellow_yuv[] = {80, 255, 0, 100, 135, 200};
+        static const int yellow_rgb[] = {255, 255, 0};
+        yuv.assign(yellow_yuv, yellow_yuv + 6);
+        rgb.assign(yellow_rgb, yellow_rgb + 3);
+      }
+      if (yuv.size() != 6)
+      {
+        ROS_ERROR("Color %s needs a yuv array of 6 limits, ignoring it", names[i].c_str());
+        continue;
+      }
+      rgb.resize(3, 255);
+      ColorClass color;
+      color.name = names[i];
+      color.y_min = yuv[0];
+      color.y_max = yuv[1];
+      color.u_min = yuv[2];
+      color.u_max = yuv[3];
+      color.v_min = yuv[4];
+      color.v_max = yuv[5];
+      color.red = rgb[0];
+      color.green = rgb[1];
+      color.blue = rgb[2];
+      classes.push_back(color);
+    }
+    finder_.lut().build(classes);
+
+    blobs_pub_ = private_nh.advertise<cmvision::Blobs>("blobs", 1);
+    image_sub_ = private_nh.subscribe<sensor_msgs::Image>("image", 1, &BlobSegmenter::imageCb, this);
+  }
+
+  void imageCb(const sensor_msgs::ImageConstPtr& image)
+  {
+    if (blobs_pub_.getNumSubscribers() == 0)
+      return;
+    if (!finder_.find(*image, min_area_, blobs_))
+    {
+      ROS_ERROR_THROTTLE(5, "Cannot segment images with encoding [%s]", image->encoding.c_str());
+      return;
+    }
+
+    const std::vector<ColorClass>& classes = finder_.lut().classes();
+    cmvision::BlobsPtr msg(new cmvision::Blobs());
+    msg->header = image->header;
+    msg->image_width = image->width;
+    msg->image_height = image->height;
+    msg->blob_count = blobs_.size();
+    msg->blobs.resize(blobs_.size());
+    for (size_t i = 0; i < blobs_.size(); ++i)
+    {
+      const ColorBlob& blob = blobs_[i];
+      const ColorClass& color = classes[blob.color];
+      cmvision::Blob& out = msg->blobs[i];
+      out.name = color.name;
+      out.red = color.red;
+      out.green = color.green;
+      out.blue = color.blue;
+      out.area = blob.area;
+      out.x = (uint32_t)(blob.x + 0.5);
+      out.y = (uint32_t)(blob.y + 0.5);
+      out.left = blob.left;
+      out.right = blob.right;
+      out.top = blob.top;
+      out.bottom = blob.bottom;
+    }
+    blobs_pub_.publish(msg);
+  }
+
+  ros::Publisher blobs_pub_;
+  ros::Subscriber image_sub_;
+};
+
+PLUGINLIB_DECLARE_CLASS(turtlebot_follower, BlobSegmenter, turtlebot_follower::BlobSegmenter, nodelet::Nodelet);
+
+}
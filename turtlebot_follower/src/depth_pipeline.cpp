@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "turtlebot_follower/depth_pipeline.h"
+#include <sensor_msgs/image_encodings.h>
+#include <std_msgs/Float32.h>
+#include <limits>
+#include <boost/lexical_cast.hpp>
+
+namespace turtlebot_follower
+{
+
+namespace
+{
+
+template<typename T>
+void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, const T& value)
+{
+  diagnostic_msgs::KeyValue kv;
+  kv.key = key;
+  kv.value = boost::lexical_cast<std::string>(value);
+  status.values.push_back(kv);
+}
+
+} // namespace
+
+DepthPipeline::DepthPipeline(const DepthCamera& camera, const FollowerSettingsConstPtr& settings)
+  : camera_(camera), settings_(settings), frame_stamp_(0.0), last_seq_(0), dropped_frames_(0),
+    command_linear_(0.0), command_angular_(0.0), odom_linear_(0.0), odom_angular_(0.0)
+{
+}
+
+DepthPipeline::~DepthPipeline()
+{
+  if (spinner_)
+    spinner_->stop();
+  sub_.shutdown();
+}
+
+void DepthPipeline::start(const ros::NodeHandle& nh, const ros::NodeHandle& private_nh)
+{
+  queue_nh_ = nh;
+  queue_nh_.setCallbackQueue(&queue_);
+  ros::NodeHandle pub_nh(private_nh);
+  scanpub_ = pub_nh.advertise<sensor_msgs::LaserScan>(camera_.scan_topic, 1);
+  closingpub_ = pub_nh.advertise<std_msgs::Float32>(camera_.closing_topic, 1);
+  ttcpub_ = pub_nh.advertise<std_msgs::Float32>(camera_.ttc_topic, 1);
+  subscribe();
+  spinner_.reset(new ros::AsyncSpinner(1, &queue_));
+  spinner_->start();
+}
+
+void DepthPipeline::subscribe()
+{
+  {
+    // Frames published while unsubscribed were never queued, so not dropped
+    boost::mutex::scoped_lock lock(mutex_);
+    last_seq_ = 0;
+  }
+  if (camera_.points)
+    sub_ = queue_nh_.subscribe<sensor_msgs::PointCloud2>(camera_.topic, 1, &DepthPipeline::cloudCb, this);
+  else if (camera_.rvl)
+    sub_ = queue_nh_.subscribe<sensor_msgs::CompressedImage>(camera_.topic, 1, &DepthPipeline::rvlCb, this);
+  else
+    sub_ = queue_nh_.subscribe<sensor_msgs::Image>(camera_.topic, 1, &DepthPipeline::depthCb, this);
+}
+
+void DepthPipeline::setActive(bool active)
+{
+  if (active && !sub_)
+    subscribe();
+  else if (!active && sub_)
+    sub_.shutdown();
+}
+
+void DepthPipeline::setRate(double rate)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  budget_.setMaxRate(rate);
+}
+
+DepthObstacles DepthPipeline::obstacles() const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  return obstacles_;
+}
+
+void DepthPipeline::diagnostics(diagnostic_msgs::DiagnosticStatus& status) const
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = budget_.enabled() ? "adaptive" : "full resolution";
+  if (budget_.level() > 0)
+  {
+    status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+    status.message = "degraded to meet the latency budget";
+  }
+
+  addValue(status, "quality_level", budget_.level());
+  addValue(status, "pixel_stride", budget_.stride());
+  addValue(status, "skipped_frames_per_decision", budget_.skip());
+  addValue(status, "cost_ms", budget_.cost() * 1000.0);
+  addValue(status, "missed_deadlines", budget_.missedDeadlines());
+  addValue(status, "dropped_frames", dropped_frames_);
+  addValue(status, "closing_speed", obstacles_.closing);
+  addValue(status, "time_to_collision", obstacles_.ttc);
+}
+
+/*!
+ * @brief Start a laser scan for a depth image.
+ * The scan has one beam per image column, ordered counterclockwise
+ * (right to left in the image), with every range at infinity.
+ */
+sensor_msgs::LaserScanPtr DepthPipeline::makeScan(const std_msgs::Header& header, uint32_t width)
+{
+  sensor_msgs::LaserScanPtr scan(new sensor_msgs::LaserScan());
+  scan->header.stamp = header.stamp;
+  scan->header.frame_id = camera_.scan_frame_id;
+  const std::vector<float>& bearing = reducer_.rays().bearing();
+  scan->angle_min = -bearing.back();
+  scan->angle_max = -bearing.front();
+  scan->angle_increment = kHorizontalFov / width;
+  scan->range_min = camera_.scan_range_min;
+  scan->range_max = camera_.scan_range_max;
+  scan->ranges.assign(width, std::numeric_limits<float>::infinity());
+  return scan;
+}
+
+/*!
+ * @brief Count the frame and decide whether to process it.
+ * Sets up the ray table and the configuration for the frame size.
+ * Only frames the budget skips count as fresh here; the others once
+ * finishFrame() has their result, so that frames failing to decode
+ * leave the depth input stale.
+ * @return false if the budget skips the frame.
+ */
+bool DepthPipeline::beginFrame(const std_msgs::Header& header, uint32_t width, uint32_t height,
+                               const FollowerSettings& settings)
+{
+  frame_stamp_ = header.stamp.isZero() ? ros::Time::now().toSec() : header.stamp.toSec();
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    // The subscriber queue only holds one frame, count the ones it
+    // dropped; a restarted driver counts from the start again
+    uint32_t seq = header.seq;
+    if (last_seq_ != 0 && seq > last_seq_ + 1)
+      dropped_frames_ += seq - last_seq_ - 1;
+    last_seq_ = seq;
+  }
+
+  const FollowerConfig& config = settings.config;
+  bool changed = reducer_.prepare(width, height, settings);
+  boost::mutex::scoped_lock lock(mutex_);
+  if (changed)
+    budget_.configure(config.budget_ms / 1000.0, config.min_decision_rate);
+
+  // Plan for whichever is faster: the base catching up with the command,
+  // or still coasting after it
+  const bool commanded = fabs(command_linear_) >= fabs(odom_linear_);
+  double linear = commanded ? command_linear_ : odom_linear_;
+  double angular = commanded ? command_angular_ : odom_angular_;
+  reducer_.setBox(settings.lookAhead(linear * cos(camera_.yaw), angular));
+  if (budget_.admit(frame_stamp_))
+    return true;
+  obstacles_.stamp = frame_stamp_;
+  return false;
+}
+
+void DepthPipeline::setCommand(double linear, double angular)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  command_linear_ = linear;
+  command_angular_ = angular;
+}
+
+void DepthPipeline::setOdometry(double linear, double angular)
+{
+  boost::mutex::scoped_lock lock(mutex_);
+  odom_linear_ = linear;
+  odom_angular_ = angular;
+}
+
+/*!
+ * @brief Publish the scan and the time to collision, and hand the
+ * result to the controller.
+ */
+void DepthPipeline::finishFrame(const BoxStats& box, const FollowerSettings& settings,
+                                const sensor_msgs::LaserScanPtr& scan, const ros::WallTime& start)
+{
+  if (scan)
+    scanpub_.publish(scan);
+
+  std_msgs::Float32Ptr closing(new std_msgs::Float32());
+  std_msgs::Float32Ptr ttc(new std_msgs::Float32());
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    obstacles_.stamp = frame_stamp_;
+    collision_.update(frame_stamp_, box.z, reducer_.box(), reducer_.histogram(),
+                      settings.config.ttc_smoothing);
+    obstacles_.processed = true;
+    obstacles_.n = box.n;
+    obstacles_.area = box.area;
+    obstacles_.threshold = settings.config.obstacle_area;
+    obstacles_.x = box.x;
+    obstacles_.y = box.y;
+    obstacles_.z = box.z;
+    closing->data = obstacles_.closing = collision_.closing();
+    ttc->data = obstacles_.ttc = collision_.timeToCollision();
+    obstacles_.histogram = reducer_.histogram();
+    budget_.record((ros::WallTime::now() - start).toSec());
+  }
+  closingpub_.publish(closing);
+  ttcpub_.publish(ttc);
+}
+
+void DepthPipeline::depthCb(const sensor_msgs::ImageConstPtr& depth_msg)
+{
+  const std::string& encoding = depth_msg->encoding;
+  const bool shorts = encoding == sensor_msgs::image_encodings::TYPE_16UC1 ||
+                      encoding == sensor_msgs::image_encodings::MONO16;
+  if (!shorts && encoding != sensor_msgs::image_encodings::TYPE_32FC1)
+  {
+    ROS_ERROR_THROTTLE(5, "Depth image of %s has unsupported encoding [%s]",
+                       camera_.name.c_str(), encoding.c_str());
+    return;
+  }
+
+  // One configuration for the whole frame
+  FollowerSettingsConstPtr settings = boost::atomic_load(&settings_);
+  if (!beginFrame(depth_msg->header, depth_msg->width, depth_msg->height, *settings))
+    return;
+  ros::WallTime start = ros::WallTime::now();
+
+  // Only reduce the scan rows if anyone listens to the scan
+  sensor_msgs::LaserScanPtr scan;
+  if (scanpub_.getNumSubscribers() > 0)
+    scan = makeScan(depth_msg->header, depth_msg->width);
+
+  BoxStats box;
+  std::vector<float>* ranges = scan ? &scan->ranges : NULL;
+  if (shorts)
+    box = reducer_.reduceImage(reinterpret_cast<const uint16_t*>(&depth_msg->data[0]),
+                               depth_msg->step / sizeof(uint16_t), *settings, stride(), ranges);
+  else
+    box = reducer_.reduceImage(reinterpret_cast<const float*>(&depth_msg->data[0]),
+                               depth_msg->step / sizeof(float), *settings, stride(), ranges);
+  finishFrame(box, *settings, scan, start);
+}
+
+void DepthPipeline::rvlCb(const sensor_msgs::CompressedImageConstPtr& rvl_msg)
+{
+  if (rvl_msg->format != kRvlFormat)
+  {
+    ROS_ERROR_THROTTLE(5, "Compressed depth of %s has format [%s] instead of RVL",
+                       camera_.name.c_str(), rvl_msg->format.c_str());
+    return;
+  }
+  // Reject a corrupt size before the reducer sizes its tables for it
+  uint32_t width, height;
+  if (!RvlDecoder::peek(rvl_msg->data, width, height))
+  {
+    ROS_ERROR_THROTTLE(5, "Corrupt RVL depth image from %s", camera_.name.c_str());
+    return;
+  }
+
+  FollowerSettingsConstPtr settings = boost::atomic_load(&settings_);
+  if (!beginFrame(rvl_msg->header, width, height, *settings))
+    return;
+  ros::WallTime start = ros::WallTime::now();
+  if (!rvl_.decode(rvl_msg->data))
+  {
+    ROS_ERROR_THROTTLE(5, "Corrupt RVL depth image from %s", camera_.name.c_str());
+    return;
+  }
+
+  sensor_msgs::LaserScanPtr scan;
+  if (scanpub_.getNumSubscribers() > 0)
+    scan = makeScan(rvl_msg->header, width);
+
+  BoxStats box = reducer_.reduceImage(rvl_.depth(), width, *settings, stride(),
+                                      scan ? &scan->ranges : NULL);
+  finishFrame(box, *settings, scan, start);
+}
+
+void DepthPipeline::cloudCb(const sensor_msgs::PointCloud2ConstPtr& cloud)
+{
+  uint32_t offsets[3];
+  // The cloud is read in place, a mis-described one would be read past its end
+  if (cloud->height < 2 || !ObstacleReducer::xyzOffsets(*cloud, offsets) ||
+      !ObstacleReducer::holdsPoints(*cloud))
+  {
+    ROS_ERROR_THROTTLE(5, "Point cloud of %s must be organized with float32 x, y and z, "
+                       "and hold all of its points", camera_.name.c_str());
+    return;
+  }
+
+  FollowerSettingsConstPtr settings = boost::atomic_load(&settings_);
+  if (!beginFrame(cloud->header, cloud->width, cloud->height, *settings))
+    return;
+  ros::WallTime start = ros::WallTime::now();
+
+  sensor_msgs::LaserScanPtr scan;
+  if (scanpub_.getNumSubscribers() > 0)
+    scan = makeScan(cloud->header, cloud->width);
+
+  BoxStats box = reducer_.reduceCloud(*cloud, offsets, *settings, stride(),
+                                      scan ? &scan->ranges : NULL);
+  finishFrame(box, *settings, scan, start);
+}
+
+} // namespace turtlebot_follower
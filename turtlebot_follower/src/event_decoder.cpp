@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Decodes the follower's binary event log into text or CSV.
+ *
+ * Usage: follower_events [--csv] FILE...
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "turtlebot_follower/event_log.h"
+#include "turtlebot_follower/follower_logic.h"
+
+using turtlebot_follower::EventRecord;
+
+namespace
+{
+
+bool earlier(const EventRecord& a, const EventRecord& b)
+{
+  return a.stamp < b.stamp;
+}
+
+/** Read all records of a log file. */
+bool readLog(const char* path, std::vector<EventRecord>& records)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file)
+  {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return false;
+  }
+  turtlebot_follower::EventFileHeader header;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, "FOLEVT01", sizeof(header.magic)) != 0 ||
+      header.record_size != sizeof(EventRecord))
+  {
+    fprintf(stderr, "%s is not a follower event log\n", path);
+    fclose(file);
+    return false;
+  }
+  EventRecord record;
+  while (fread(&record, sizeof(record), 1, file) == 1)
+    records.push_back(record);
+  fclose(file);
+  return true;
+}
+
+void printText(const EventRecord& r)
+{
+  using namespace turtlebot_follower;
+  printf("%.6f [%u] %-8s ", r.stamp / 1e9, r.thread, eventName(r.id));
+  switch (r.id)
+  {
+    case EVENT_STATE:
+      printf("%s -> %s\n", FollowerLogic::stateName((int)r.values[0]), FollowerLogic::stateName(r.arg));
+      break;
+    case EVENT_FACE:
+      if (r.arg > 0)
+        printf("%d faces, x %.3f, width %.0f\n", r.arg, r.values[0], r.values[1]);
+      else
+        printf("lost\n");
+      break;
+    case EVENT_OBSTACLE:
+      printf("%s, %.0f of %.0f cm2, steering %.3f\n", r.arg ? "blocked" : "clear",
+             r.values[0], r.values[1], r.values[2]);
+      break;
+    case EVENT_MARKER:
+      if (r.arg > 0)
+        printf("area %d, x %.0f\n", r.arg, r.values[0]);
+      else
+        printf("lost\n");
+      break;
+    case EVENT_PROFILE:
+      if (r.arg)
+        printf("depth %.1f Hz, detector %.1f Hz (0: every frame)\n", r.values[0], r.values[1]);
+      else
+        printf("inputs off\n");
+      break;
+    case EVENT_STALE:
+      printf("input %d is %.3fs old\n", r.arg, r.values[0]);
+      break;
+    case EVENT_KEY:
+      printf("code %d\n", r.arg);
+      break;
+    case EVENT_DROPPED:
+      printf("%d records\n", r.arg);
+      break;
+    default:
+      printf("\n");
+  }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  bool csv = false;
+  std::vector<EventRecord> records;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (std::string(argv[i]) == "--csv")
+      csv = true;
+    else if (!readLog(argv[i], records))
+      return 1;
+  }
+  if (argc < 2)
+  {
+    fprintf(stderr, "Usage: follower_events [--csv] FILE...\n");
+    return 1;
+  }
+
+  // Flushes interleave the threads; restore the order of events
+  std::stable_sort(records.begin(), records.end(), earlier);
+
+  if (csv)
+    printf("stamp,thread,event,arg,v0,v1,v2,v3\n");
+  for (size_t i = 0; i < records.size(); ++i)
+  {
+    const EventRecord& r = records[i];
+    if (csv)
+      printf("%.9f,%u,%s,%d,%g,%g,%g,%g\n", r.stamp / 1e9, r.thread,
+             turtlebot_follower::eventName(r.id), r.arg,
+             r.values[0], r.values[1], r.values[2], r.values[3]);
+    else
+      printText(r);
+  }
+  return 0;
+}
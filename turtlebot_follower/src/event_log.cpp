@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "turtlebot_follower/event_log.h"
+#include <algorithm>
+#include <cstring>
+#include <ros/ros.h>
+
+namespace turtlebot_follower
+{
+
+namespace
+{
+
+const char kMagic[8] = {'F', 'O', 'L', 'E', 'V', 'T', '0', '1'};
+
+} // namespace
+
+// The rings belong to the log; threads only borrow them
+EventLog::EventLog() : file_(NULL), local_(&EventLog::keepRing), dropped_(0)
+{
+}
+
+EventLog::~EventLog()
+{
+  close();
+}
+
+bool EventLog::open(const std::string& path, double period)
+{
+  close();
+  file_ = fopen(path.c_str(), "ab");
+  if (!file_)
+    return false;
+  if (ftell(file_) == 0)
+  {
+    EventFileHeader header;
+    memcpy(header.magic, kMagic, sizeof(header.magic));
+    header.record_size = sizeof(EventRecord);
+    header.reserved = 0;
+    fwrite(&header, sizeof(header), 1, file_);
+  }
+  flusher_.reset(new boost::thread(&EventLog::run, this, period));
+  return true;
+}
+
+void EventLog::close()
+{
+  if (flusher_)
+  {
+    flusher_->interrupt();
+    flusher_->join();
+    flusher_.reset();
+  }
+  if (file_)
+  {
+    flush();
+    fclose(file_);
+    file_ = NULL;
+  }
+}
+
+void EventLog::write(EventId id, int32_t arg, float v0, float v1, float v2, float v3)
+{
+  if (!file_)
+    return;
+  Ring* r = ring();
+  const uint32_t head = r->head.load(boost::memory_order_relaxed);
+  if (head - r->tail.load(boost::memory_order_acquire) >= (uint32_t)Ring::kSize)
+  {
+    dropped_.fetch_add(1, boost::memory_order_relaxed);
+    return;
+  }
+
+  EventRecord& record = r->slots[head % Ring::kSize];
+  record.stamp = ros::Time::now().toNSec();
+  record.id = id;
+  record.thread = r->thread;
+  record.arg = arg;
+  record.values[0] = v0;
+  record.values[1] = v1;
+  record.values[2] = v2;
+  record.values[3] = v3;
+  r->head.store(head + 1, boost::memory_order_release);
+}
+
+/*!
+ * @brief The ring of the calling thread, created on its first write.
+ */
+EventLog::Ring* EventLog::ring()
+{
+  Ring* r = local_.get();
+  if (r)
+    return r;
+  boost::mutex::scoped_lock lock(rings_mutex_);
+  rings_.push_back(boost::shared_ptr<Ring>(new Ring(rings_.size())));
+  r = rings_.back().get();
+  local_.reset(r);
+  return r;
+}
+
+/*!
+ * @brief Move the records of all rings to the file.
+ * Only ever called by one thread at a time.
+ */
+void EventLog::flush()
+{
+  batch_.clear();
+  {
+    boost::mutex::scoped_lock lock(rings_mutex_);
+    for (size_t i = 0; i < rings_.size(); ++i)
+    {
+      Ring& r = *rings_[i];
+      uint32_t tail = r.tail.load(boost::memory_order_relaxed);
+      const uint32_t head = r.head.load(boost::memory_order_acquire);
+      for (; tail != head; ++tail)
+        batch_.push_back(r.slots[tail % Ring::kSize]);
+      r.tail.store(tail, boost::memory_order_release);
+    }
+  }
+
+  uint32_t dropped = dropped_.exchange(0, boost::memory_order_relaxed);
+  if (dropped > 0)
+  {
+    EventRecord record = EventRecord();
+    record.stamp = ros::Time::now().toNSec();
+    record.id = EVENT_DROPPED;
+    record.thread = 0xffff;
+    record.arg = dropped;
+    batch_.push_back(record);
+  }
+
+  if (batch_.empty())
+    return;
+  fwrite(&batch_[0], sizeof(EventRecord), batch_.size(), file_);
+  fflush(file_);
+}
+
+void EventLog::run(double period)
+{
+  const boost::posix_time::time_duration sleep =
+      boost::posix_time::microseconds((int64_t)(period * 1e6));
+  try
+  {
+    for (;;)
+    {
+      boost::this_thread::sleep(sleep);
+      flush();
+    }
+  }
+  catch (const boost::thread_interrupted&)
+  {
+  }
+}
+
+} // namespace turtlebot_follower
@@ -0,0 +1,424 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ros/ros.h>
+#include <pluginlib/class_list_macros.h>
+#include <nodelet/nodelet.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <std_msgs/Empty.h>
+#include <std_msgs/Float32.h>
+#include "hog_haar_person_detection/Faces.h"
+#include <boost/thread/mutex.hpp>
+#include <cmath>
+#include <deque>
+#include "turtlebot_follower/image_roi.h"
+#include "turtlebot_follower/person_memory.h"
+#include "turtlebot_follower/template_tracker.h"
+
+namespace turtlebot_follower
+{
+
+//* Tracking-driven region of interest for the face detector.
+/**
+ * Sits between the camera and the face detector. Once a face is
+ * being followed, only a crop around its predicted position is
+ * handed to the detector, downscaled to a fixed detector width, and
+ * the detections are mapped back to full frame coordinates before
+ * they reach the follower. Every so often, and whenever the target
+ * is lost, the full frame is scanned instead.
+ *
+ * The detector only runs every detect_interval images. In between, a
+ * template tracker follows the face at camera rate and its positions
+ * are published to the follower like detections. A detection is also
+ * requested early as soon as the tracker loses confidence.
+ *
+ * The crop of every detector image is also published as a CameraInfo
+ * with the roi and binning fields set, like image_proc's crop_decimate.
+ *
+ * When the follower reports an engagement, the tracked person is
+ * remembered for a while and their faces are dropped from the
+ * detections, so the follower moves on to someone else.
+ *
+ * The follower also sets on detector_rate how many images per second
+ * the detector gets at most; the tracker keeps running in between.
+ */
+class FaceRoi : public nodelet::Nodelet
+{
+public:
+  FaceRoi() : roi_scale_(3.0), min_roi_(96), detector_width_(160),
+              full_frame_interval_(15), lost_frames_(3), full_binning_(1),
+              detect_interval_(5), min_confidence_(0.6),
+              has_target_(false), target_x_(0.0), target_y_(0.0), target_size_(0.0),
+              velocity_x_(0.0), velocity_y_(0.0),
+              frames_since_full_(0), frames_since_detect_(0), misses_(0),
+              detector_period_(0.0)
+  {
+  }
+
+private:
+  double roi_scale_; /**< The crop size relative to the face size */
+  int min_roi_; /**< The minimum crop size in pixels */
+  int detector_width_; /**< The width the crops are downscaled to */
+  int full_frame_interval_; /**< Scan the full frame at least every this many images */
+  int lost_frames_; /**< Scan the full frame after this many crops without a face */
+  int full_binning_; /**< The downscaling of full frame scans */
+  int detect_interval_; /**< Run the detector every this many images while tracking */
+  double min_confidence_; /**< Ask for a detection when tracking gets less confident */
+
+  boost::mutex mutex_;
+  bool has_target_; /**< Whether a face is being tracked */
+  double target_x_; /**< The center of the tracked face, in pixels */
+  double target_y_;
+  double target_size_; /**< The width of the tracked face, in pixels */
+  double velocity_x_; /**< The image velocity of the face, in pixels/s */
+  double velocity_y_;
+  ros::Time target_stamp_; /**< When the face was last seen */
+  int frames_since_full_;
+  int frames_since_detect_;
+  int misses_;
+  double detector_period_; /**< The shortest time between detector images, 0 for none */
+  ros::Time last_detect_stamp_; /**< The stamp of the last image sent to the detector */
+  TemplateTracker tracker_; /**< Follows the face between detections */
+  sensor_msgs::ImageConstPtr target_image_; /**< The last image the face was seen in */
+  PersonMemory engaged_; /**< The people engaged recently */
+
+  struct Crop
+  {
+    std_msgs::Header header;
+    ImageRoi roi;
+    bool full; /**< Whether this was a full frame scan */
+    sensor_msgs::ImageConstPtr image; /**< The image, to take tracking templates from */
+  };
+  std::deque<Crop> crops_; /**< Crops waiting for detections */
+
+  virtual void onInit()
+  {
+    ros::NodeHandle& private_nh = getPrivateNodeHandle();
+
+    private_nh.getParam("roi_scale", roi_scale_);
+    private_nh.getParam("min_roi", min_roi_);
+    private_nh.getParam("detector_width", detector_width_);
+    private_nh.getParam("full_frame_interval", full_frame_interval_);
+    private_nh.getParam("lost_frames", lost_frames_);
+    private_nh.getParam("full_binning", full_binning_);
+    private_nh.getParam("detect_interval", detect_interval_);
+    private_nh.getParam("min_confidence", min_confidence_);
+    int template_size = 24;
+    int search_radius = 8;
+    private_nh.getParam("template_size", template_size);
+    private_nh.getParam("search_radius", search_radius);
+    tracker_.configure(template_size, search_radius);
+    int memory_size = 32;
+    double memory_ttl = 300.0;
+    double memory_threshold = 0.5;
+    private_nh.getParam("memory_size", memory_size);
+    private_nh.getParam("memory_ttl", memory_ttl);
+    private_nh.getParam("memory_threshold", memory_threshold);
+    engaged_.configure(memory_size, memory_ttl, memory_threshold);
+
+    image_pub_ = private_nh.advertise<sensor_msgs::Image>("roi/image", 1);
+    info_pub_ = private_nh.advertise<sensor_msgs::CameraInfo>("roi/camera_info", 1);
+    faces_pub_ = private_nh.advertise<hog_haar_person_detection::Faces>("faces", 10);
+
+    image_sub_ = private_nh.subscribe<sensor_msgs::Image>("image", 1, &FaceRoi::imageCb, this);
+    detections_sub_ = private_nh.subscribe<hog_haar_person_detection::Faces>("detections", 10, &FaceRoi::detectionsCb, this);
+    engaged_sub_ = private_nh.subscribe<std_msgs::Empty>("engaged", 1, &FaceRoi::engagedCb, this);
+    rate_sub_ = private_nh.subscribe<std_msgs::Float32>("detector_rate", 1, &FaceRoi::detectorRateCb, this);
+  }
+
+  /*!
+   * @brief Pick the region the detector should search in this image.
+   */
+  ImageRoi chooseRoi(const sensor_msgs::Image& image, bool& full)
+  {
+    full = !has_target_ || misses_ >= lost_frames_ ||
+                ++frames_since_full_ >= full_frame_interval_;
+    if (full)
+    {
+      frames_since_full_ = 0;
+      return ImageRoi(0, 0, image.width, image.height, full_binning_);
+    }
+
+    // Constant velocity prediction since the last detection
+    double dt = std::min(std::max((image.header.stamp - target_stamp_).toSec(), 0.0), 0.5);
+    double cx = target_x_ + velocity_x_ * dt;
+    double cy = target_y_ + velocity_y_ * dt;
+    int size = std::max((int)(target_size_ * roi_scale_), min_roi_);
+    int binning = std::max(1, (int)ceil((double)size / detector_width_));
+
+    ImageRoi roi((int)(cx - size / 2), (int)(cy - size / 2), size, size, binning);
+    // Slide the crop back inside the image rather than shrinking it
+    roi.x = std::min(roi.x, (int)image.width - size);
+    roi.y = std::min(roi.y, (int)image.height - size);
+    return roi;
+  }
+
+  /*!
+   * @brief Follow the face into a new image with the template tracker.
+   * @return The tracked face, or nothing if tracking is not confident.
+   */
+  hog_haar_person_detection::FacesPtr trackTarget(const sensor_msgs::ImageConstPtr& image_ptr)
+  {
+    const sensor_msgs::Image& image = *image_ptr;
+    double dt = std::min(std::max((image.header.stamp - target_stamp_).toSec(), 0.0), 0.5);
+    double cx = target_x_ + velocity_x_ * dt;
+    double cy = target_y_ + velocity_y_ * dt;
+    if (tracker_.track(image, cx, cy) < min_confidence_)
+      return hog_haar_person_detection::FacesPtr();
+
+    if (dt > 0.0)
+    {
+      velocity_x_ = (cx - target_x_) / dt;
+      velocity_y_ = (cy - target_y_) / dt;
+    }
+    target_x_ = cx;
+    target_y_ = cy;
+    target_stamp_ = image.header.stamp;
+    target_image_ = image_ptr;
+
+    hog_haar_person_detection::FacesPtr faces(new hog_haar_person_detection::Faces());
+    faces->header = image.header;
+    hog_haar_person_detection::BoundingBox face;
+    face.center.x = cx;
+    face.center.y = cy;
+    face.width = face.height = target_size_;
+    faces->faces.push_back(face);
+    return faces;
+  }
+
+  void imageCb(const sensor_msgs::ImageConstPtr& image)
+  {
+    if (image_pub_.getNumSubscribers() == 0 && faces_pub_.getNumSubscribers() == 0)
+      return;
+
+    ImageRoi roi;
+    hog_haar_person_detection::FacesPtr tracked;
+    bool throttled;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      // The follower may need fewer detections than the camera rate
+      throttled = detector_period_ > 0.0 && image->header.stamp >= last_detect_stamp_ &&
+                  (image->header.stamp - last_detect_stamp_).toSec() < detector_period_;
+      // Between detector runs the tracker keeps the target up to date
+      if (has_target_ && tracker_.valid() && (++frames_since_detect_ < detect_interval_ || throttled))
+        tracked = trackTarget(image);
+    }
+    if (tracked)
+    {
+      faces_pub_.publish(tracked);
+      return;
+    }
+
+    if (throttled || image_pub_.getNumSubscribers() == 0)
+      return;
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      frames_since_detect_ = 0;
+      last_detect_stamp_ = image->header.stamp;
+      bool full;
+      roi = chooseRoi(*image, full);
+      roi.clip(image->width, image->height);
+      roi.width -= roi.width % roi.binning;
+      roi.height -= roi.height % roi.binning;
+
+      Crop crop;
+      crop.header = image->header;
+      crop.roi = roi;
+      crop.full = full;
+      crop.image = image;
+      crops_.push_back(crop);
+      while (crops_.size() > 16)
+        crops_.pop_front();
+    }
+
+    sensor_msgs::ImagePtr out(new sensor_msgs::Image());
+    if (!cropDecimate(*image, roi, *out))
+    {
+      ROS_ERROR_THROTTLE(5, "Cannot crop images with encoding [%s]", image->encoding.c_str());
+      return;
+    }
+    image_pub_.publish(out);
+
+    sensor_msgs::CameraInfoPtr info(new sensor_msgs::CameraInfo());
+    info->header = image->header;
+    info->width = image->width;
+    info->height = image->height;
+    info->binning_x = info->binning_y = roi.binning;
+    info->roi.x_offset = roi.x;
+    info->roi.y_offset = roi.y;
+    info->roi.width = roi.width;
+    info->roi.height = roi.height;
+    info_pub_.publish(info);
+  }
+
+  /*!
+   * @brief Map detections in a crop back to the full frame.
+   */
+  void detectionsCb(const hog_haar_person_detection::Faces::ConstPtr& detections)
+  {
+    hog_haar_person_detection::FacesPtr faces(new hog_haar_person_detection::Faces(*detections));
+    {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (crops_.empty())
+        return;
+
+      // Find the crop the detector worked on; fall back to the newest one
+      Crop crop = crops_.back();
+      for (std::deque<Crop>::iterator it = crops_.begin(); it != crops_.end(); ++it)
+      {
+        if (it->header.stamp == detections->header.stamp)
+        {
+          crop = *it;
+          crops_.erase(crops_.begin(), it + 1);
+          break;
+        }
+      }
+
+      faces->header = crop.header;
+      const ImageRoi& roi = crop.roi;
+      for (size_t i = 0; i < faces->faces.size(); ++i)
+      {
+        hog_haar_person_detection::BoundingBox& face = faces->faces[i];
+        face.center.x = roi.x + face.center.x * roi.binning;
+        face.center.y = roi.y + face.center.y * roi.binning;
+        face.width *= roi.binning;
+        face.height *= roi.binning;
+      }
+      forgetEngaged(*faces, *crop.image);
+      updateTarget(*faces, crop);
+    }
+    faces_pub_.publish(faces);
+  }
+
+  /*!
+   * @brief Drop the faces of people engaged recently.
+   */
+  void forgetEngaged(hog_haar_person_detection::Faces& faces, const sensor_msgs::Image& image)
+  {
+    const double now = faces.header.stamp.toSec();
+    if (engaged_.live(now) == 0)
+      return;
+    std::vector<hog_haar_person_detection::BoundingBox> kept;
+    for (size_t i = 0; i < faces.faces.size(); ++i)
+    {
+      const hog_haar_person_detection::BoundingBox& face = faces.faces[i];
+      PersonDescriptor person;
+      if (person.compute(image, face.center.x, face.center.y, std::max(face.width, face.height)) &&
+          engaged_.recall(person, now))
+        continue;
+      kept.push_back(face);
+    }
+    faces.faces.swap(kept);
+  }
+
+  /** Cap the images sent to the detector, 0 sends as many as the tracking asks for. */
+  void detectorRateCb(const std_msgs::Float32ConstPtr& msg)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    detector_period_ = msg->data > 0.0f ? 1.0 / msg->data : 0.0;
+  }
+
+  /*!
+   * @brief Remember the tracked person once the follower engaged them,
+   * and look for someone else.
+   */
+  void engagedCb(const std_msgs::EmptyConstPtr& msg)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (!has_target_ || !target_image_)
+      return;
+    PersonDescriptor person;
+    if (!person.compute(*target_image_, target_x_, target_y_, target_size_))
+      return;
+    engaged_.remember(person, target_stamp_.toSec());
+    has_target_ = false;
+    tracker_.reset();
+    ROS_INFO("Engaged a person, %zu remembered", engaged_.live(target_stamp_.toSec()));
+  }
+
+  void updateTarget(const hog_haar_person_detection::Faces& faces, const Crop& crop)
+  {
+    if (faces.faces.empty())
+    {
+      // Nothing in a full frame scan means the target is gone
+      if (crop.full)
+      {
+        has_target_ = false;
+        tracker_.reset();
+      }
+      else
+        ++misses_;
+      return;
+    }
+
+    const hog_haar_person_detection::BoundingBox& face = faces.faces[0];
+    tracker_.init(*crop.image, face.center.x, face.center.y, std::max(face.width, face.height));
+    if (has_target_ && faces.header.stamp < target_stamp_)
+    {
+      // The tracker has already moved past this image; keep its position
+      misses_ = 0;
+      target_size_ = std::max(face.width, face.height);
+      return;
+    }
+
+    if (has_target_ && misses_ == 0)
+    {
+      double dt = (faces.header.stamp - target_stamp_).toSec();
+      if (dt > 0.0)
+      {
+        velocity_x_ = (face.center.x - target_x_) / dt;
+        velocity_y_ = (face.center.y - target_y_) / dt;
+      }
+    }
+    else
+    {
+      velocity_x_ = velocity_y_ = 0.0;
+    }
+    has_target_ = true;
+    misses_ = 0;
+    target_x_ = face.center.x;
+    target_y_ = face.center.y;
+    target_size_ = std::max(face.width, face.height);
+    target_stamp_ = faces.header.stamp;
+    target_image_ = crop.image;
+  }
+
+  ros::Publisher image_pub_;
+  ros::Publisher info_pub_;
+  ros::Publisher faces_pub_;
+  ros::Subscriber image_sub_;
+  ros::Subscriber detections_sub_;
+  ros::Subscriber engaged_sub_;
+  ros::Subscriber rate_sub_;
+};
+
+PLUGINLIB_DECLARE_CLASS(turtlebot_follower, FaceRoi, turtlebot_follower::FaceRoi, nodelet::Nodelet);
+
+}
@@ -0,0 +1,634 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Headless closed-loop simulator for the follower.
+ *
+ * Drives the follower's obstacle pass (ObstacleReducer) and state
+ * machine (FollowerLogic) with a kinematic Kobuki in a 2D world of
+ * walls, pillars and people. Depth images are rendered at the sensor's
+ * resolution and field of view, face detections are generated from the
+ * people in view. No ROS master, Gazebo or network is involved, and
+ * the simulation runs as fast as the CPU allows. Independent scenarios
+ * run in parallel on a pool of threads; one CSV line per scenario
+ * reports the time to the first engagement and the collisions.
+ *
+ * Usage: follower_sim [--scenarios N] [--threads N] [--seed N]
+ *                     [--duration SEC] [--width PX] [--height PX]
+ *                     [--people N] [--pillars N] [--face-latency SEC]
+ *                     [--output FILE]
+ *                     [--set name=value]...
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/normal_distribution.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+#include <boost/thread/thread.hpp>
+#include "turtlebot_follower/collision_estimator.h"
+#include "turtlebot_follower/follower_logic.h"
+#include "turtlebot_follower/local_planner.h"
+#include "turtlebot_follower/follower_settings.h"
+#include "turtlebot_follower/obstacle_reducer.h"
+#include "turtlebot_follower/pose_history.h"
+#include "turtlebot_follower/search_planner.h"
+
+namespace turtlebot_follower
+{
+namespace sim
+{
+
+const double kPhysicsStep = 0.01; /**< Integration step, in s */
+const double kDepthPeriod = 1.0 / 30.0; /**< Depth camera period, in s */
+const double kFacesPeriod = 1.0 / 10.0; /**< Face detector period, in s */
+const double kRobotRadius = 0.177; /**< Kobuki footprint radius, in m */
+const double kCameraHeight = 0.3; /**< Height of the 3d sensor above the floor, in m */
+const double kMinRange = 0.45; /**< Closer depth is invalid, in m */
+const double kMaxRange = 4.0; /**< Farther depth is invalid, in m */
+const double kPersonRadius = 0.25; /**< Footprint radius of a person, in m */
+const double kPersonHeight = 1.7; /**< Height of a person, in m */
+const double kWallHeight = 2.0; /**< Height of walls and pillars, in m */
+const double kDetectionRate = 0.85; /**< Probability that a visible face is detected */
+
+inline double normalize(double angle)
+{
+  while (angle > M_PI) angle -= 2.0 * M_PI;
+  while (angle < -M_PI) angle += 2.0 * M_PI;
+  return angle;
+}
+
+struct Segment
+{
+  double x0, y0, x1, y1;
+};
+
+struct Person
+{
+  double x, y;
+  double facing; /**< The direction the person looks at, in rad */
+};
+
+struct Pose
+{
+  double x, y, theta;
+};
+
+/** What a horizontal ray hits first. */
+struct Hit
+{
+  double range; /**< Horizontal distance, infinite if nothing */
+  double height; /**< Height of the object */
+  int person; /**< The person hit, or -1 */
+};
+
+//* A flat world of walls, pillars and people.
+struct World
+{
+  std::vector<Segment> walls;
+  std::vector<Person> people;
+
+  void addBox(double x0, double y0, double x1, double y1)
+  {
+    Segment s[4] = {{x0, y0, x1, y0}, {x1, y0, x1, y1}, {x1, y1, x0, y1}, {x0, y1, x0, y0}};
+    walls.insert(walls.end(), s, s + 4);
+  }
+
+  /** Cast a horizontal ray from (x, y) in direction angle. */
+  Hit cast(double x, double y, double angle) const
+  {
+    const double dx = cos(angle), dy = sin(angle);
+    Hit hit = {std::numeric_limits<double>::infinity(), 0.0, -1};
+    for (size_t i = 0; i < walls.size(); ++i)
+    {
+      const Segment& s = walls[i];
+      const double ex = s.x1 - s.x0, ey = s.y1 - s.y0;
+      const double denom = dx * ey - dy * ex;
+      if (fabs(denom) < 1e-12) continue;
+      const double t = ((s.x0 - x) * ey - (s.y0 - y) * ex) / denom;
+      const double u = ((s.x0 - x) * dy - (s.y0 - y) * dx) / denom;
+      if (t > 0.0 && u >= 0.0 && u <= 1.0 && t < hit.range)
+      {
+        hit.range = t;
+        hit.height = kWallHeight;
+        hit.person = -1;
+      }
+    }
+    for (size_t i = 0; i < people.size(); ++i)
+    {
+      const double px = people[i].x - x, py = people[i].y - y;
+      const double along = px * dx + py * dy;
+      const double across2 = px * px + py * py - along * along;
+      if (along <= 0.0 || across2 > kPersonRadius * kPersonRadius) continue;
+      const double t = along - sqrt(kPersonRadius * kPersonRadius - across2);
+      if (t > 0.0 && t < hit.range)
+      {
+        hit.range = t;
+        hit.height = kPersonHeight;
+        hit.person = i;
+      }
+    }
+    return hit;
+  }
+
+  /** Whether a robot at (x, y), grown by margin, overlaps anything. */
+  bool collides(double x, double y, double margin = 0.0) const
+  {
+    const double radius = kRobotRadius + margin;
+    for (size_t i = 0; i < walls.size(); ++i)
+    {
+      const Segment& s = walls[i];
+      const double ex = s.x1 - s.x0, ey = s.y1 - s.y0;
+      double t = ((x - s.x0) * ex + (y - s.y0) * ey) / (ex * ex + ey * ey);
+      t = std::min(1.0, std::max(0.0, t));
+      const double cx = s.x0 + t * ex - x, cy = s.y0 + t * ey - y;
+      if (cx * cx + cy * cy < radius * radius)
+        return true;
+    }
+    for (size_t i = 0; i < people.size(); ++i)
+    {
+      const double cx = people[i].x - x, cy = people[i].y - y;
+      const double r = radius + kPersonRadius;
+      if (cx * cx + cy * cy < r * r)
+        return true;
+    }
+    return false;
+  }
+};
+
+//* Kinematic Kobuki base.
+/**
+ * Follows the commanded Twist within the acceleration limits of the
+ * velocity smoother and integrates the differential drive exactly.
+ */
+struct Kobuki
+{
+  Kobuki() : v(0.0), w(0.0) {}
+
+  void step(double cmd_v, double cmd_w, double dt, Pose& pose)
+  {
+    const double max_v = 0.7, max_w = M_PI;
+    const double acc_v = 0.8, acc_w = 3.5;
+    cmd_v = std::min(max_v, std::max(-max_v, cmd_v));
+    cmd_w = std::min(max_w, std::max(-max_w, cmd_w));
+    v += std::min(acc_v * dt, std::max(-acc_v * dt, cmd_v - v));
+    w += std::min(acc_w * dt, std::max(-acc_w * dt, cmd_w - w));
+
+    if (fabs(w) < 1e-6)
+    {
+      pose.x += v * dt * cos(pose.theta);
+      pose.y += v * dt * sin(pose.theta);
+    }
+    else
+    {
+      const double r = v / w;
+      const double theta = pose.theta + w * dt;
+      pose.x += r * (sin(theta) - sin(pose.theta));
+      pose.y -= r * (cos(theta) - cos(pose.theta));
+      pose.theta = normalize(theta);
+    }
+  }
+
+  double v, w;
+};
+
+//* Synthetic depth images and face detections.
+class Sensors
+{
+public:
+  Sensors(int width, int height) : width_(width), height_(height), depth_(width * height)
+  {
+    bearing_.resize(width);
+    for (int u = 0; u < width; ++u)
+      bearing_[u] = (u - width / 2.0) * kHorizontalFov / width;
+    tan_elevation_.resize(height);
+    for (int v = 0; v < height; ++v)
+      tan_elevation_[v] = tan((height / 2.0 - v) * kVerticalFov / height);
+  }
+
+  /** Render a 16UC1 depth image, in mm, seen from the robot pose. */
+  const std::vector<uint16_t>& renderDepth(const World& world, const Pose& pose)
+  {
+    for (int u = 0; u < width_; ++u)
+    {
+      // Image bearings are positive to the right, world angles counterclockwise
+      const double bearing = bearing_[u];
+      const Hit hit = world.cast(pose.x, pose.y, pose.theta - bearing);
+      const double cos_b = cos(bearing);
+      for (int v = 0; v < height_; ++v)
+      {
+        const double tan_e = tan_elevation_[v];
+        double range = std::numeric_limits<double>::infinity();
+        const double z = kCameraHeight + hit.range * tan_e;
+        if (z >= 0.0 && z <= hit.height)
+          range = hit.range;
+        else if (tan_e < 0.0)
+          range = std::min(hit.range, kCameraHeight / -tan_e);
+        const double depth = range * cos_b;
+        depth_[v * width_ + u] = depth >= kMinRange && depth <= kMaxRange
+                                 ? (uint16_t)(depth * 1000.0 + 0.5) : 0;
+      }
+    }
+    return depth_;
+  }
+
+  /** A face seen by the detector, in the 640 pixel detector image. */
+  struct Face
+  {
+    double center_x, center_y, width;
+  };
+
+  /** The faces the detector reports, the widest first. */
+  template<class Rng>
+  std::vector<Face> detectFaces(const World& world, const Pose& pose, Rng& rng)
+  {
+    boost::random::uniform_real_distribution<double> uniform(0.0, 1.0);
+    boost::random::normal_distribution<double> jitter(0.0, 4.0);
+    std::vector<Face> faces;
+    for (size_t i = 0; i < world.people.size(); ++i)
+    {
+      const Person& person = world.people[i];
+      const double dx = person.x - pose.x, dy = person.y - pose.y;
+      const double distance = sqrt(dx * dx + dy * dy);
+      const double bearing = normalize(pose.theta - atan2(dy, dx));
+      if (fabs(bearing) > kHorizontalFov / 2 || distance > kMaxRange + 1.0)
+        continue;
+      // Only faces turned towards the camera, and not hidden behind something
+      if (fabs(normalize(atan2(-dy, -dx) - person.facing)) > 70.0 * M_PI / 180.0)
+        continue;
+      if (world.cast(pose.x, pose.y, pose.theta - bearing).person != (int)i)
+        continue;
+      if (uniform(rng) > kDetectionRate)
+        continue;
+      Face face;
+      face.width = 640.0 * 2.0 * atan(kFaceWidth / 2.0 / distance) / kHorizontalFov;
+      face.center_x = 320.0 + bearing / kHorizontalFov * 640.0 + jitter(rng);
+      face.center_y = 240.0 + jitter(rng);
+      faces.push_back(face);
+    }
+    std::sort(faces.begin(), faces.end(), widerFirst);
+    return faces;
+  }
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+private:
+  static bool widerFirst(const Face& a, const Face& b) { return a.width > b.width; }
+
+  int width_, height_;
+  std::vector<double> bearing_;
+  std::vector<double> tan_elevation_;
+  std::vector<uint16_t> depth_;
+};
+
+struct Options
+{
+  Options() : scenarios(32), threads(boost::thread::hardware_concurrency()), seed(1),
+              duration(120.0), width(640), height(480), people(3), pillars(2),
+              face_latency(0.3) {}
+  int scenarios;
+  unsigned int threads;
+  unsigned int seed;
+  double duration;
+  int width, height;
+  int people, pillars;
+  double face_latency; /**< The age of the images the faces are detected in, in s */
+  std::string output;
+  FollowerConfig config;
+};
+
+struct Result
+{
+  unsigned int seed;
+  bool engaged;
+  double time_to_engage;
+  unsigned int collisions;
+  double distance;
+  double avoid_time;
+  unsigned int depth_frames; /**< The depth frames processed, fewer in low power */
+  double wall_time;
+};
+
+/** A random room with pillars, people and a free start pose. */
+template<class Rng>
+void makeScenario(const Options& options, Rng& rng, World& world, Pose& start)
+{
+  boost::random::uniform_real_distribution<double> uniform(0.0, 1.0);
+  const double width = 6.0 + 4.0 * uniform(rng), depth = 5.0 + 3.0 * uniform(rng);
+  world.addBox(0.0, 0.0, width, depth);
+
+  for (int i = 0; i < options.pillars; ++i)
+  {
+    const double x = 1.0 + (width - 2.5) * uniform(rng), y = 1.0 + (depth - 2.5) * uniform(rng);
+    const double size = 0.3 + 0.4 * uniform(rng);
+    world.addBox(x, y, x + size, y + size);
+  }
+
+  for (int i = 0; i < options.people; ++i)
+  {
+    Person person;
+    do
+    {
+      person.x = 0.8 + (width - 1.6) * uniform(rng);
+      person.y = 0.8 + (depth - 1.6) * uniform(rng);
+    } while (world.collides(person.x, person.y));
+    person.facing = 2.0 * M_PI * uniform(rng);
+    world.people.push_back(person);
+  }
+
+  do
+  {
+    start.x = 0.5 + (width - 1.0) * uniform(rng);
+    start.y = 0.5 + (depth - 1.0) * uniform(rng);
+  } while (world.collides(start.x, start.y));
+  start.theta = 2.0 * M_PI * uniform(rng);
+}
+
+/** Run one scenario until the first engagement or the time limit. */
+Result runScenario(const Options& options, unsigned int seed)
+{
+  boost::random::mt19937 rng(seed);
+  World world;
+  Pose pose;
+  makeScenario(options, rng, world, pose);
+
+  Result result = {seed, false, 0.0, 0, 0.0, 0.0, 0, 0.0};
+  boost::posix_time::ptime wall_start = boost::posix_time::microsec_clock::universal_time();
+
+  FollowerSettings settings(options.config, 1);
+  const FollowerConfig& config = settings.config;
+  Sensors sensors(options.width, options.height);
+  ObstacleReducer reducer;
+  CollisionEstimator collision;
+  FollowerLogic logic;
+  Kobuki base;
+  // Odometry starts at the start pose, the search grids are centered on it
+  const Pose origin = pose;
+  VisitedGrid visited;
+  SightingHeatmap heatmap;
+  SearchPlanner planner;
+  LocalPlanner local_planner;
+  PoseHistory odometry;
+
+  bool blocked = false;
+  bool have_depth = false;
+  bool colliding = false;
+  double cmd_v = 0.0, cmd_w = 0.0;
+  double next_depth = 0.0, next_faces = 0.0;
+  // The perception of the state, like the nodelet applies it
+  ResourceProfile profile;
+  double last_face = 0.0;
+  const int steps = (int)(options.duration / kPhysicsStep);
+  for (int step = 0; step < steps; ++step)
+  {
+    const double t = step * kPhysicsStep;
+    odometry.add(t, pose.x, pose.y, pose.theta);
+    if (t >= next_depth)
+    {
+      next_depth += std::max(kDepthPeriod, profile.depth_rate > 0.0 ? 1.0 / profile.depth_rate : 0.0);
+      ++result.depth_frames;
+      const std::vector<uint16_t>& depth = sensors.renderDepth(world, pose);
+      reducer.prepare(sensors.width(), sensors.height(), settings);
+      // Like the pipeline, size the box for the faster of command and base
+      if (fabs(cmd_v) >= fabs(base.v))
+        reducer.setBox(settings.lookAhead(cmd_v, cmd_w));
+      else
+        reducer.setBox(settings.lookAhead(base.v, base.w));
+      BoxStats box = reducer.reduceImage(&depth[0], sensors.width(), settings, 1, NULL);
+      blocked = box.area > config.obstacle_area;
+      collision.update(t, box.z, reducer.box(), reducer.histogram(), config.ttc_smoothing);
+      have_depth = true;
+      visited.mark(pose.x - origin.x, pose.y - origin.y, pose.theta);
+    }
+
+    // The state machine runs on every detector message, like the nodelet
+    if (t >= next_faces && have_depth)
+    {
+      next_faces += std::max(kFacesPeriod, profile.detector_rate > 0.0 ? 1.0 / profile.detector_rate : 0.0);
+      // The detector reports on an image taken a while ago
+      StampedPose seen = odometry.latest();
+      odometry.poseAt(t - options.face_latency, seen);
+      Pose camera = {seen.x, seen.y, seen.yaw};
+      std::vector<Sensors::Face> faces = sensors.detectFaces(world, camera, rng);
+      double yaw_change = 0.0;
+      if (config.latency_compensation)
+        odometry.yawSince(t - options.face_latency, yaw_change);
+      if (faces.empty())
+        logic.loseFace();
+      else
+      {
+        logic.seeFace(faces[0].center_x, faces[0].center_y, faces[0].width, yaw_change);
+        last_face = t;
+      }
+      logic.setObstacles(config, blocked, false, &reducer.histogram());
+      logic.setCollisionTime(collision.timeToCollision());
+      if (logic.faceFound())
+        logic.setSearchHeading(false, 0.0);
+      else
+      {
+        double heading = planner.plan(t, pose.x - origin.x, pose.y - origin.y, pose.theta,
+                                      visited, heatmap, config.heatmap_weight);
+        logic.setSearchHeading(true, normalize(heading - pose.theta));
+      }
+
+      FollowerLogic::State state = logic.decide(config, cmd_v, cmd_w);
+      profile = logic.profile(config, config.low_power_delay > 0.0 && t - last_face > config.low_power_delay);
+      if (state == FollowerLogic::ENGAGE)
+      {
+        result.engaged = true;
+        result.time_to_engage = t;
+        break;
+      }
+      if (config.local_planner)
+      {
+        local_planner.moveObstacles(t, pose.x, pose.y, pose.theta, config.obstacle_memory);
+        local_planner.addObstacles(reducer.histogram(), 0.0, 0.0, 0.0, kMinRange, config.histogram_range);
+        local_planner.plan(t, config, logic.goal(), base.v, base.w, cmd_v, cmd_w);
+      }
+    }
+    if (logic.state() == FollowerLogic::AVOID_OBSTACLE)
+      result.avoid_time += kPhysicsStep;
+
+    Pose next = pose;
+    base.step(cmd_v, cmd_w, kPhysicsStep, next);
+    if (world.collides(next.x, next.y))
+    {
+      // The bumper stops the base
+      if (!colliding)
+        ++result.collisions;
+      colliding = true;
+      base.v = 0.0;
+      pose.theta = next.theta;
+      continue;
+    }
+    // A new collision needs the bumper released first
+    colliding = colliding && world.collides(next.x, next.y, 0.02);
+    result.distance += hypot(next.x - pose.x, next.y - pose.y);
+    pose = next;
+  }
+
+  result.wall_time = (boost::posix_time::microsec_clock::universal_time() - wall_start)
+                     .total_microseconds() / 1e6;
+  return result;
+}
+
+void worker(const Options& options, boost::atomic<int>& next, std::vector<Result>& results)
+{
+  int i;
+  while ((i = next.fetch_add(1)) < options.scenarios)
+    results[i] = runScenario(options, options.seed + i);
+}
+
+/** Set a configuration parameter by name, whatever its type. */
+bool setParameter(FollowerConfig& config, const std::string& assignment)
+{
+  size_t eq = assignment.find('=');
+  if (eq == std::string::npos)
+    return false;
+  const std::string name = assignment.substr(0, eq), value = assignment.substr(eq + 1);
+
+  dynamic_reconfigure::Config msg;
+  try
+  {
+    dynamic_reconfigure::DoubleParameter d;
+    d.name = name;
+    d.value = boost::lexical_cast<double>(value);
+    msg.doubles.push_back(d);
+    dynamic_reconfigure::IntParameter i;
+    i.name = name;
+    i.value = (int)d.value;
+    msg.ints.push_back(i);
+  }
+  catch (const boost::bad_lexical_cast&)
+  {
+    if (value != "true" && value != "false")
+      return false;
+  }
+  dynamic_reconfigure::BoolParameter b;
+  b.name = name;
+  b.value = value == "true" || (value != "false" && value != "0");
+  msg.bools.push_back(b);
+  return config.__fromMessage__(msg);
+}
+
+} // namespace sim
+} // namespace turtlebot_follower
+
+int main(int argc, char** argv)
+{
+  using namespace turtlebot_follower::sim;
+  Options options;
+  options.config = turtlebot_follower::FollowerConfig::__getDefault__();
+
+  for (int i = 1; i < argc; ++i)
+  {
+    const std::string arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+    if (!value)
+    {
+      fprintf(stderr, "Missing value for %s\n", arg.c_str());
+      return 1;
+    }
+    ++i;
+    if (arg == "--scenarios") options.scenarios = atoi(value);
+    else if (arg == "--threads") options.threads = std::max(1, atoi(value));
+    else if (arg == "--seed") options.seed = atoi(value);
+    else if (arg == "--duration") options.duration = atof(value);
+    else if (arg == "--width") options.width = atoi(value);
+    else if (arg == "--height") options.height = atoi(value);
+    else if (arg == "--people") options.people = atoi(value);
+    else if (arg == "--pillars") options.pillars = atoi(value);
+    else if (arg == "--face-latency") options.face_latency = atof(value);
+    else if (arg == "--output") options.output = value;
+    else if (arg == "--set")
+    {
+      if (!setParameter(options.config, value))
+      {
+        fprintf(stderr, "Bad parameter %s\n", value);
+        return 1;
+      }
+    }
+    else
+    {
+      fprintf(stderr, "Unknown option %s\n", arg.c_str());
+      return 1;
+    }
+  }
+  options.threads = std::max(1u, std::min(options.threads, (unsigned int)options.scenarios));
+
+  std::vector<Result> results(options.scenarios);
+  boost::atomic<int> next(0);
+  boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+  boost::thread_group pool;
+  for (unsigned int i = 0; i < options.threads; ++i)
+    pool.create_thread(boost::bind(&worker, boost::cref(options), boost::ref(next), boost::ref(results)));
+  pool.join_all();
+  double wall = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1e6;
+
+  FILE* out = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+  if (!out)
+  {
+    fprintf(stderr, "Cannot write %s\n", options.output.c_str());
+    return 1;
+  }
+  fprintf(out, "scenario,seed,engaged,time_to_engage,collisions,distance,avoid_time,depth_frames,wall_time\n");
+  unsigned int engaged = 0, collisions = 0;
+  double engage_time = 0.0;
+  for (int i = 0; i < options.scenarios; ++i)
+  {
+    const Result& r = results[i];
+    fprintf(out, "%d,%u,%d,%.2f,%u,%.2f,%.2f,%u,%.3f\n", i, r.seed, r.engaged ? 1 : 0,
+            r.engaged ? r.time_to_engage : options.duration, r.collisions, r.distance,
+            r.avoid_time, r.depth_frames, r.wall_time);
+    engaged += r.engaged;
+    collisions += r.collisions;
+    if (r.engaged)
+      engage_time += r.time_to_engage;
+  }
+  if (out != stdout)
+    fclose(out);
+
+  fprintf(stderr, "%d scenarios on %u threads in %.1fs (%.0fx real time)\n",
+          options.scenarios, options.threads, wall,
+          options.scenarios * options.duration / std::max(wall, 1e-3));
+  fprintf(stderr, "engaged %u/%d, mean time to engage %.1fs, %.2f collisions per scenario\n",
+          engaged, options.scenarios, engaged ? engage_time / engaged : 0.0,
+          (double)collisions / std::max(options.scenarios, 1));
+  return 0;
+}
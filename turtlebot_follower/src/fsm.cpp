@@ -28,10 +28,18 @@
  */
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <pluginlib/class_list_macros.h>
 #include <nodelet/nodelet.h>
 #include <geometry_msgs/Twist.h>
 #include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
+#include <sensor_msgs/LaserScan.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <nav_msgs/Odometry.h>
+#include <std_msgs/Empty.h>
+#include <std_msgs/Float32.h>
+#include <tf/tf.h>
 #include <visualization_msgs/Marker.h>
 #include <turtlebot_msgs/SetFollowState.h>
 #include <cmvision/Blob.h>
@@ -43,15 +51,80 @@
 #include "hog_haar_person_detection/BoundingBox.h"
 #include <depth_image_proc/depth_traits.h>
 #include "keyboard/Key.h"
+#include <limits>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "turtlebot_follower/debug_visualizer.h"
+#include "turtlebot_follower/depth_pipeline.h"
+#include "turtlebot_follower/event_log.h"
+#include "turtlebot_follower/follower_logic.h"
+#include "turtlebot_follower/follower_settings.h"
+#include "turtlebot_follower/local_planner.h"
+#include "turtlebot_follower/pose_history.h"
+#include "turtlebot_follower/search_planner.h"
+#include "turtlebot_follower/staleness_watchdog.h"
 
 namespace turtlebot_follower
 {
 
+//* Runs a function from a callback queue.
+class FunctionCallback : public ros::CallbackInterface
+{
+public:
+  explicit FunctionCallback(const boost::function<void()>& function) : function_(function) {}
+
+  virtual CallResult call()
+  {
+    function_();
+    return Success;
+  }
+
+private:
+  boost::function<void()> function_;
+};
+
+//* The usual depth topic of a camera read in the given input mode.
+static std::string depthTopic(const std::string& input_mode)
+{
+  if (input_mode == "points")
+    return "depth/points";
+  if (input_mode == "rvl")
+    return "depth/image_rect/rvl";
+  return "depth/image_rect";
+}
+
 //* The turtlebot follower nodelet.
 /**
  * The turtlebot follower nodelet. Subscribes to point clouds
  * from the 3dsensor, processes them, and publishes command vel
  * messages.
+ *
+ * Every depth camera listed in the depth_cameras parameter gets its
+ * own DepthPipeline; their latest results are merged whenever the
+ * state machine runs. Forward looking cameras decide whether there
+ * is an obstacle ahead, cameras looking backwards whether the robot
+ * may reverse out of it.
+ *
+ * Callbacks run on queues of their own, so that nothing slow holds
+ * up the latency critical ones: each depth camera has a thread (see
+ * DepthPipeline), faces, odometry and the watchdog share the
+ * light_threads of the light queue, and the keyboard, the services
+ * and housekeeping timers share the control_threads of the control
+ * queue. The greeting, which blocks for seconds, has a thread of its
+ * own so that the stop service always answers right away.
+ *
+ * Decisions are recorded in a binary event log rather than printed;
+ * follower_events decodes it.
+ *
+ * While searching, the robot turns towards the headings odometry says
+ * it has looked at least, and where faces were seen before.
+ *
+ * Each state's resource profile is applied when the state is entered:
+ * the depth pipelines cap their frame rate, and face_roi is told on
+ * detector_rate how often to run the detector. A search without faces
+ * for low_power_delay drops to the low power rates, and with following
+ * off the depth and face topics are not subscribed at all.
  */
 class TurtlebotFollower : public nodelet::Nodelet
 {
@@ -60,41 +133,86 @@ public:
    * @brief The constructor for the follower.
    * Constructor for the follower.
    */
-  TurtlebotFollower() : min_y_(0.1), max_y_(0.5),
-                        min_x_(-0.2), max_x_(0.2),
-                        max_z_(0.8), goal_z_(0.6),
-                        z_scale_(1.0), x_scale_(5.0)
+  TurtlebotFollower() : enabled_(true), scan_range_min_(0.45), scan_range_max_(4.0),
+                        scan_frame_id_("camera_depth_frame"),
+                        viz_rate_(5.0), watchdog_rate_(10.0),
+                        faces_topic_("/person_detection/faces"),
+                        epoch_(0), following_marker_(false),
+                        watchdog_epoch_(0), speed_scale_(1.0), stopped_(true),
+                        watchdog_ticks_(0), has_pose_(false), pose_x_(0.0), pose_y_(0.0),
+                        pose_yaw_(0.0), odom_linear_(0.0), odom_angular_(0.0),
+                        command_linear_(0.0), command_angular_(0.0), last_face_time_(0.0)
   {
 
   }
 
   ~TurtlebotFollower()
   {
+    // Stop all callback threads before the state they use goes away
+    if (light_spinner_)
+      light_spinner_->stop();
+    if (control_spinner_)
+      control_spinner_->stop();
+    if (speech_spinner_)
+      speech_spinner_->stop();
+    pipelines_.clear();
     delete config_srv_;
   }
 
 private:
-  double min_y_; /**< The minimum y position of the points in the box. */
-  double max_y_; /**< The maximum y position of the points in the box. */
-  double min_x_; /**< The minimum x position of the points in the box. */
-  double max_x_; /**< The maximum x position of the points in the box. */
-  double max_z_; /**< The maximum z position of the points in the box. */
-  double goal_z_; /**< The distance away from the robot to hold the centroid */
-  double z_scale_; /**< The scaling factor for translational robot speed */
-  double x_scale_; /**< The scaling factor for rotational robot speed */
-  bool   enabled_; /**< Enable/disable following; just prevents motor commands */
-  
-
-  bool face_found;
-  float x_face;
-  float y_face;
-
-
-  int STATE;
+  bool   enabled_; /**< Enable/disable following; prevents motor commands and drops the inputs */
+  double scan_range_min_; /**< The minimum valid range of the laser scan */
+  double scan_range_max_; /**< The maximum valid range of the laser scan */
+  std::string scan_frame_id_; /**< The frame of the laser scan */
+  double viz_rate_; /**< The rate of the debug markers */
+  double watchdog_rate_; /**< The rate the input ages are checked at */
+  std::string faces_topic_; /**< The topic of the face detections */
+
+  /**
+   * The current configuration. Replaced as a whole by reconfigure()
+   * and only accessed through boost::atomic_load/atomic_store.
+   */
+  FollowerSettingsConstPtr settings_;
+  uint64_t epoch_; /**< The epoch of the last configuration built */
 
-  float obstacle_detected;
-  float is_close_to_human;
+  boost::mutex state_mutex_; /**< Guards the state machine and the watchdog against the light queue threads */
+  FollowerLogic logic_; /**< The state machine */
+  std::string marker_color_; /**< The blob color to follow while there is no face, or empty */
+  bool following_marker_; /**< Whether the target is a blob rather than a face */
   float has_candies;
+
+  std::vector<boost::shared_ptr<DepthPipeline> > pipelines_; /**< One per depth camera */
+
+  DebugVisualizer viz_; /**< Debug markers, only built while someone watches */
+  EventLog events_; /**< State transitions and obstacle flips, for after the fact */
+
+  StalenessWatchdog watchdog_; /**< Ages of the inputs against their SLOs */
+  std::vector<int> depth_inputs_; /**< The watchdog ids of the depth cameras */
+  int faces_input_; /**< The watchdog id of the face detections */
+  uint64_t watchdog_epoch_; /**< The configuration epoch of the watchdog limits */
+  double speed_scale_; /**< Velocity scaling while inputs are late */
+  bool stopped_; /**< Whether the robot is held because the depth input is stale */
+  unsigned int watchdog_ticks_;
+
+  boost::mutex search_mutex_; /**< Guards the poses and the search state, odometry arrives on another thread */
+  PoseHistory poses_; /**< The recent odometry, to undo the robot's motion since an image */
+  VisitedGrid visited_; /**< The cells the camera has looked at */
+  boost::scoped_ptr<SightingHeatmap> heatmap_; /**< Where faces were seen, kept across runs */
+  SearchPlanner search_planner_;
+  bool has_pose_; /**< Whether odometry has arrived */
+  double pose_x_; /**< The robot position in the odometry frame */
+  double pose_y_;
+  double pose_yaw_;
+  double odom_linear_; /**< The velocity the base reports */
+  double odom_angular_;
+
+  LocalPlanner local_planner_; /**< Drives to the goal of each state, guarded by state_mutex_ */
+  double command_linear_; /**< The velocity last sent to the base */
+  double command_angular_;
+
+  ResourceProfile profile_; /**< The perception applied to the inputs, guarded by state_mutex_ */
+  boost::mutex inputs_mutex_; /**< Serializes subscribing and dropping the inputs, never taken under state_mutex_ */
+  double last_face_time_; /**< When a face was last seen, for the low power profile */
   //color_found = false;
   // Service for start/stop following
   ros::ServiceServer switch_srv_;
@@ -110,88 +228,232 @@ private:
 
  // UPDATE STATE 
 void updateState(){
-  if(face_found == false && obstacle_detected == false && is_close_to_human==false){
-    STATE = 0;
-    TurtlebotFollower::searchMode();
+  FollowerSettingsConstPtr settings = boost::atomic_load(&settings_);
+  const FollowerConfig& config = settings->config;
+  mergeObstacles(config);
+  planSearch(config);
+
+  geometry_msgs::TwistPtr cmd(new geometry_msgs::Twist());
+  FollowerLogic::State previous = logic_.state();
+  FollowerLogic::State state = logic_.decide(config, cmd->linear.x, cmd->angular.z);
+  if (config.local_planner)
+    planMotion(config, cmd);
+  const double now = ros::Time::now().toSec();
+  const bool low_power = config.low_power_delay > 0.0 && now - last_face_time_ > config.low_power_delay;
+  applyProfile(config, logic_.profile(config, low_power));
+  // Greet once; the robot stands still until the greeting is over
+  if (state == FollowerLogic::ENGAGE && previous != FollowerLogic::ENGAGE && !logic_.greeting())
+  {
+    events_.write(EVENT_ENGAGE);
+    logic_.setGreeting(true);
+    // Speaking blocks for seconds; keep it off the queues with services
+    speech_queue_.addCallback(ros::CallbackInterfacePtr(new FunctionCallback(
+        boost::bind(&TurtlebotFollower::engageWithHuman, this))));
   }
+  publishCmd(cmd);
+
+  if (state != previous)
+    events_.write(EVENT_STATE, state, previous);
+  viz_.setState(state, FollowerLogic::stateName(state));
 
-  else if(obstacle_detected == true && is_close_to_human==false){
-    STATE = 1;
-    TurtlebotFollower::avoidObstacle();
-  }
 
-  else if(face_found == true && obstacle_detected == false && is_close_to_human==false){
-    STATE = 2;
-    TurtlebotFollower::moveToHuman();
+}
+
+void engageWithHuman(){
+  system("espeak -v en 'HI, I AM CHEZ BOT. HOW ARE YOU?'");
+  //system("espeak -v en 'WOULD YOU LIKE A CANDY? IF SO PRESS MY SPACEBAR'");
+  {
+    boost::mutex::scoped_lock lock(state_mutex_);
+    logic_.setGreeting(false);
   }
+  // Only now face_roi hides this person and the search goes on
+  engagedpub_.publish(std_msgs::EmptyPtr(new std_msgs::Empty()));
+};
+
 
-  else if(face_found == true && is_close_to_human==true){
-    STATE = 3;
-    TurtlebotFollower::engageWithHuman();
+/*!
+   * @brief Publish a velocity command, slowed down or held back while
+   * inputs are late.
+   */
+  void publishCmd(const geometry_msgs::TwistPtr& cmd)
+  {
+    if (stopped_ || !enabled_)
+      return;
+    cmd->linear.x *= speed_scale_;
+    cmd->angular.z *= speed_scale_;
+    cmdpub_.publish(cmd);
+    noteCommand(cmd->linear.x, cmd->angular.z);
   }
 
-  else{STATE=0; TurtlebotFollower::searchMode();}
+  /**
+   * Remember a velocity command sent to the base, and let the depth
+   * pipelines size their obstacle box for it.
+   */
+  void noteCommand(double linear, double angular)
+  {
+    command_linear_ = linear;
+    command_angular_ = angular;
+    for (size_t i = 0; i < pipelines_.size(); ++i)
+      pipelines_[i]->setCommand(linear, angular);
+  }
 
-  ROS_INFO_THROTTLE(1, "STATE IS: %d\n", STATE);
+  /*!
+   * @brief Set the inputs up for the perception a state needs.
+   * Does nothing unless the profile changed; with following off the
+   * inputs stay unsubscribed whatever the state. Called with
+   * state_mutex_ held, so the subscriptions change later on the light
+   * queue, see applyInputs().
+   */
+  void applyProfile(const FollowerConfig& config, ResourceProfile profile)
+  {
+    if (!enabled_)
+      profile.active = false;
+    if (profile == profile_)
+      return;
+    profile_ = profile;
+    events_.write(EVENT_PROFILE, profile.active, profile.depth_rate, profile.detector_rate);
+
+    for (size_t i = 0; i < pipelines_.size(); ++i)
+      pipelines_[i]->setRate(profile.depth_rate);
+    light_queue_.addCallback(ros::CallbackInterfacePtr(new FunctionCallback(
+        boost::bind(&TurtlebotFollower::applyInputs, this))));
+
+    std_msgs::Float32Ptr rate(new std_msgs::Float32());
+    rate->data = profile.detector_rate;
+    detectorratepub_.publish(rate);
+    setFaceLimits(config);
+  }
 
+  /*!
+   * @brief Subscribe or drop the depth and face inputs as the current
+   * profile says.
+   * Must not hold state_mutex_: shutting a subscription down waits for
+   * its callback in flight, and the face callback waits for that lock.
+   */
+  void applyInputs()
+  {
+    boost::mutex::scoped_lock inputs_lock(inputs_mutex_);
+    bool active;
+    {
+      boost::mutex::scoped_lock lock(state_mutex_);
+      active = profile_.active;
+    }
 
-}
+    for (size_t i = 0; i < pipelines_.size(); ++i)
+      pipelines_[i]->setActive(active);
+    if (active && !facesSubscriber)
+      facesSubscriber = light_nh_.subscribe(faces_topic_, 1, &TurtlebotFollower::personDetectionCallBack, this);
+    else if (!active)
+      facesSubscriber.shutdown();
+  }
 
-void searchMode(){
-  geometry_msgs::TwistPtr cmd2(new geometry_msgs::Twist());
-  cmd2->linear.x = 0.3;
-  cmdpub_.publish(cmd2);
-}
+  /** The face age limits, loosened to the detector rate of the profile. */
+  void setFaceLimits(const FollowerConfig& config)
+  {
+    double slow = config.faces_slow_age, stop = config.faces_stop_age;
+    if (profile_.detector_rate > 0.0)
+    {
+      slow = std::max(slow, 2.0 / profile_.detector_rate);
+      stop = std::max(stop, 4.0 / profile_.detector_rate);
+    }
+    watchdog_.setLimits(faces_input_, slow, stop);
+  }
 
-void engageWithHuman(){
-  system("espeak -v en 'HI, I AM CHEZ BOT. HOW ARE YOU?'");
-  //system("espeak -v en 'WOULD YOU LIKE A CANDY? IF SO PRESS MY SPACEBAR'");
-};
+  /*!
+   * @brief Start or stop following.
+   * Stopping holds the robot right away and drops the depth and face
+   * inputs shortly after; they are subscribed again when following
+   * restarts.
+   */
+  bool changeModeSrvCb(turtlebot_msgs::SetFollowState::Request& request,
+                       turtlebot_msgs::SetFollowState::Response& response)
+  {
+    boost::mutex::scoped_lock lock(state_mutex_);
+    FollowerSettingsConstPtr settings = boost::atomic_load(&settings_);
+    if (enabled_ && request.state == request.STOPPED)
+    {
+      ROS_INFO("Change mode service request: following stopped");
+      cmdpub_.publish(geometry_msgs::TwistPtr(new geometry_msgs::Twist()));
+      noteCommand(0.0, 0.0);
+      enabled_ = false;
+    }
+    else if (!enabled_ && request.state == request.FOLLOW)
+    {
+      ROS_INFO("Change mode service request: following (re)started");
+      enabled_ = true;
+      // Start over with the full profile, the next decision picks the state's
+      last_face_time_ = ros::Time::now().toSec();
+    }
+    applyProfile(settings->config, ResourceProfile());
 
+    response.result = response.OK;
+    return true;
+  }
 
-void avoidObstacle(){
-  geometry_msgs::TwistPtr cmd2(new geometry_msgs::Twist());
-  cmd2->linear.x = -1.0;
-  cmdpub_.publish(cmd2);
-};
+  /*!
+   * @brief Replace the fixed command of the state by the local planner's.
+   * Plans from the odometry velocity, or from the last command without
+   * odometry.
+   */
+  void planMotion(const FollowerConfig& config, const geometry_msgs::TwistPtr& cmd)
+  {
+    double linear = command_linear_, angular = command_angular_;
+    {
+      boost::mutex::scoped_lock lock(search_mutex_);
+      if (has_pose_)
+      {
+        linear = odom_linear_;
+        angular = odom_angular_;
+      }
+    }
+    if (!local_planner_.plan(ros::Time::now().toSec(), config, logic_.goal(), linear, angular,
+                             cmd->linear.x, cmd->angular.z))
+      ROS_DEBUG_THROTTLE(1, "No collision free velocity, braking");
+  }
 
-void moveToHuman(){
-        ROS_INFO_THROTTLE("GO TO HUMAN\n");
-        geometry_msgs::TwistPtr cmd(new geometry_msgs::Twist());
-        cmd->linear.x = 0.2;//(z - goal_z_) * z_scale_;
-        cmd->angular.z = -x_face * z_scale_;
-        cmdpub_.publish(cmd);
-};
+  /** A header stamp in seconds, or now for unstamped messages. */
+  static double stampOrNow(const ros::Time& stamp)
+  {
+    return stamp.isZero() ? ros::Time::now().toSec() : stamp.toSec();
+  }
 
 // UPDATE FACE DETECTION
 void personDetectionCallBack(const hog_haar_person_detection::Faces facelist)
 {
-  float tmp_x = 0.0;
-  float tmp_y = 0.0;
-  float count = 0;
+  boost::mutex::scoped_lock lock(state_mutex_);
+  watchdog_.touch(faces_input_, stampOrNow(facelist.header.stamp));
   //ROS_INFO_THROTTLE(1, facelist);
   //ROS_INFO_THROTTLE(1, "FACE CHECK\n");
   //ROS_INFO_THROTTLE(1, "%f\n", facelist.faces[0].center.x);
   
   //if(sizeof(facelist.faces) != 0){ 
           if(!facelist.faces.empty()){
-    ROS_INFO_THROTTLE(1, "FACE FOUND\n");
-    
-
-         y_face = ((facelist.faces[0].center.y - 320.0)/640.0 + y_face)/2.0;
-         x_face = ((facelist.faces[0].center.x - 320.0)/640.0 + x_face)/2.0;
+         last_face_time_ = stampOrNow(facelist.header.stamp);
+         // The heatmap counts where people turn up, not how long they stay
+         if (!logic_.faceFound() || following_marker_)
+           addSightings(facelist);
+         if (!logic_.faceFound())
+           events_.write(EVENT_FACE, facelist.faces.size(), facelist.faces[0].center.x,
+                         facelist.faces[0].width);
+
+         following_marker_ = false;
+         logic_.seeFace(facelist.faces[0].center.x, facelist.faces[0].center.y,
+                        facelist.faces[0].width, yawSince(facelist.header.stamp));
       //ROS_INFO_THROTTLE(1, "%f\n", x_face);
-         face_found = true;
 
-         if(facelist.faces[0].width >100){
-          is_close_to_human = true;
-         }else{is_close_to_human = false;}
-      int i = 0;
-
-   }else{
-    ROS_INFO_THROTTLE(1, "FACE ->NOT<- FOUND\n");
-    face_found = false;
-    is_close_to_human=false;
+         if (viz_.active())
+         {
+           std::vector<double> bearings;
+           for (size_t i = 0; i < facelist.faces.size(); ++i)
+             bearings.push_back((facelist.faces[i].center.x - 320.0)/640.0 * kHorizontalFov);
+           viz_.setFaces(bearings);
+         }
+
+   }else if (!following_marker_){
+    if (logic_.faceFound())
+      events_.write(EVENT_FACE, 0);
+    viz_.setFaces(std::vector<double>());
+    logic_.loseFace();
   }
           
 TurtlebotFollower::updateState();
@@ -199,65 +461,311 @@ TurtlebotFollower::updateState();
 }
 
 
-// UPDATE OBSTACLE DETECTION
+  /*!
+   * @brief Follow the largest blob of the marker color while there is no face.
+   * The marker is approached like a face that never gets close enough
+   * to engage; a face seen meanwhile takes over.
+   */
+  void blobsCb(const cmvision::BlobsConstPtr& blobs)
+  {
+    boost::mutex::scoped_lock lock(state_mutex_);
+    if (logic_.faceFound() && !following_marker_)
+      return;
+
+    // Blobs come largest first
+    const cmvision::Blob* marker = NULL;
+    for (size_t i = 0; i < blobs->blobs.size() && !marker; ++i)
+      if (blobs->blobs[i].name == marker_color_)
+        marker = &blobs->blobs[i];
+
+    if (!marker)
+    {
+      if (following_marker_)
+      {
+        events_.write(EVENT_MARKER, 0);
+        following_marker_ = false;
+        logic_.loseFace();
+        updateState();
+      }
+      return;
+    }
+
+    if (!following_marker_)
+      events_.write(EVENT_MARKER, marker->area, marker->x);
+    following_marker_ = true;
+    const double scale = 640.0 / std::max(blobs->image_width, 1u);
+    logic_.seeFace(marker->x * scale, marker->y * scale, 0.0, yawSince(blobs->header.stamp));
+    updateState();
+  }
+
+  /*!
+   * @brief Track the robot pose and mark what the camera sees from it.
+   */
+  void odomCb(const nav_msgs::OdometryConstPtr& odom)
+  {
+    for (size_t i = 0; i < pipelines_.size(); ++i)
+      pipelines_[i]->setOdometry(odom->twist.twist.linear.x, odom->twist.twist.angular.z);
+
+    boost::mutex::scoped_lock lock(search_mutex_);
+    odom_linear_ = odom->twist.twist.linear.x;
+    odom_angular_ = odom->twist.twist.angular.z;
+    pose_x_ = odom->pose.pose.position.x;
+    pose_y_ = odom->pose.pose.position.y;
+    pose_yaw_ = tf::getYaw(odom->pose.pose.orientation);
+    has_pose_ = true;
+    poses_.add(stampOrNow(odom->header.stamp), pose_x_, pose_y_, pose_yaw_);
+    visited_.mark(pose_x_, pose_y_, pose_yaw_);
+  }
+
+  /*!
+   * @brief How far the robot turned since a sensor stamp, positive to
+   * the left, or 0 without odometry that far back.
+   */
+  double yawSince(const ros::Time& stamp)
+  {
+    FollowerSettingsConstPtr settings = boost::atomic_load(&settings_);
+    double change = 0.0;
+    if (!settings->config.latency_compensation || stamp.isZero())
+      return change;
+    boost::mutex::scoped_lock lock(search_mutex_);
+    poses_.yawSince(stamp.toSec(), change);
+    return change;
+  }
 
-  void updateObstacle(const sensor_msgs::ImageConstPtr& depth_msg)
+  /*!
+   * @brief Put the detected faces on the heatmap.
+   * Called once when faces are found, not for every detection while
+   * they stay in view. The distance to a face follows from its width
+   * in the image.
+   */
+  void addSightings(const hog_haar_person_detection::Faces& facelist)
   {
+    boost::mutex::scoped_lock lock(search_mutex_);
+    if (!has_pose_)
+      return;
+    const double focal = 320.0 / tan(kHorizontalFov / 2.0);
+    for (size_t i = 0; i < facelist.faces.size(); ++i)
+    {
+      if (facelist.faces[i].width <= 0)
+        continue;
+      double distance = kFaceWidth * focal / facelist.faces[i].width;
+      double bearing = pose_yaw_ - (facelist.faces[i].center.x - 320.0)/640.0 * kHorizontalFov;
+      heatmap_->addSighting(pose_x_ + distance * cos(bearing), pose_y_ + distance * sin(bearing));
+    }
+  }
+
+  /*!
+   * @brief Point the search at the most promising heading.
+   * Without odometry the search drives straight on.
+   */
+  void planSearch(const FollowerConfig& config)
+  {
+    boost::mutex::scoped_lock lock(search_mutex_);
+    if (!has_pose_ || logic_.faceFound())
+    {
+      logic_.setSearchHeading(false, 0.0);
+      return;
+    }
+    double heading = search_planner_.plan(ros::Time::now().toSec(), pose_x_, pose_y_, pose_yaw_,
+                                          visited_, *heatmap_, config.heatmap_weight);
+    logic_.setSearchHeading(true, remainder(heading - pose_yaw_, 2.0 * M_PI));
+  }
+
+  /*!
+   * @brief Slowly forget what was searched and where faces were seen.
+   */
+  void searchDecayCb(const ros::TimerEvent& event)
+  {
+    boost::mutex::scoped_lock lock(search_mutex_);
+    visited_.decay();
+    heatmap_->decay(0.99f);
+  }
+
+  /*!
+   * @brief Merge the latest results of all depth cameras.
+   * Any forward camera blocked means an obstacle ahead; the first
+   * forward camera with a result steers around it, and the shortest
+   * time to collision of the forward cameras sets the speed. The local
+   * planner gets the nearest points of all cameras.
+   */
+  void mergeObstacles(const FollowerConfig& config)
+  {
+    bool blocked = false;
+    bool rear_blocked = false;
+    float ttc = kNoCollision;
+    DepthObstacles ahead;
+    {
+      boost::mutex::scoped_lock lock(search_mutex_);
+      if (has_pose_)
+        local_planner_.moveObstacles(ros::Time::now().toSec(), pose_x_, pose_y_, pose_yaw_,
+                                     config.obstacle_memory);
+      else
+        local_planner_.clearObstacles();
+    }
+    for (size_t i = 0; i < pipelines_.size(); ++i)
+    {
+      const DepthObstacles obstacles = pipelines_[i]->obstacles();
+      const DepthCamera& camera = pipelines_[i]->camera();
+      if (obstacles.processed)
+        local_planner_.addObstacles(obstacles.histogram, camera.x, camera.y, camera.yaw,
+                                    camera.scan_range_min, config.histogram_range);
+      if (!camera.forward())
+      {
+        rear_blocked = rear_blocked || obstacles.blocked() ||
+                       watchdog_.health(depth_inputs_[i]) == StalenessWatchdog::STALE;
+        continue;
+      }
+      blocked = blocked || obstacles.blocked();
+      if (obstacles.processed)
+        ttc = std::min(ttc, obstacles.ttc);
+      if (!ahead.processed && obstacles.processed)
+        ahead = obstacles;
+    }
+    const bool was_blocked = logic_.obstacle();
+    logic_.setObstacles(config, blocked, rear_blocked, ahead.processed ? &ahead.histogram : NULL);
+    logic_.setCollisionTime(ttc);
+    if (blocked != was_blocked)
+      events_.write(EVENT_OBSTACLE, blocked, ahead.area * 1e4f, ahead.threshold * 1e4f, logic_.steerBearing());
+
+    if (ahead.processed && viz_.active())
+    {
+      viz_.setCentroid(ahead.n > 0, ahead.x / ahead.n, ahead.y / ahead.n, ahead.z);
+      viz_.setSteering(logic_.steerFound(), logic_.steerBearing());
+    }
+  }
+
+  /*!
+   * @brief Check the age of the inputs and degrade the behaviour.
+   * Late inputs slow the robot down; a stale forward depth stream
+   * stops it until depth images arrive again, and a stale face stream
+   * drops the face and keeps the state machine going without it.
+   */
+  void watchdogCb(const ros::TimerEvent& event)
+  {
+    boost::mutex::scoped_lock lock(state_mutex_);
+    FollowerSettingsConstPtr settings = boost::atomic_load(&settings_);
+    const FollowerConfig& config = settings->config;
+    if (settings->epoch != watchdog_epoch_)
+    {
+      for (size_t i = 0; i < depth_inputs_.size(); ++i)
+        watchdog_.setLimits(depth_inputs_[i], config.depth_slow_age, config.depth_stop_age);
+      setFaceLimits(config);
+      watchdog_epoch_ = settings->epoch;
+    }
+
+    if (++watchdog_ticks_ >= watchdog_rate_)
+    {
+      watchdog_ticks_ = 0;
+      publishDiagnostics(config);
+    }
+
+    // Nothing arrives while following is off, so nothing can be late
+    if (!enabled_)
+      return;
 
-    // Precompute the sin function for each row and column
-    uint32_t image_width = depth_msg->width;
-    float x_radians_per_pixel = 60.0/57.0/image_width;
-    float sin_pixel_x[image_width];
-    for (int x = 0; x < image_width; ++x) {
-      sin_pixel_x[x] = sin((x - image_width/ 2.0)  * x_radians_per_pixel);
+    for (size_t i = 0; i < pipelines_.size(); ++i)
+    {
+      double stamp = pipelines_[i]->obstacles().stamp;
+      if (stamp > 0.0)
+        watchdog_.touch(depth_inputs_[i], stamp);
     }
 
-    uint32_t image_height = depth_msg->height;
-    float y_radians_per_pixel = 45.0/57.0/image_width;
-    float sin_pixel_y[image_height];
-    for (int y = 0; y < image_height; ++y) {
-      // Sign opposite x for y up values
-      sin_pixel_y[y] = sin((image_height/ 2.0 - y)  * y_radians_per_pixel);
+    StalenessWatchdog::Health worst = watchdog_.check(ros::Time::now().toSec());
+    StalenessWatchdog::Health faces = watchdog_.health(faces_input_);
+    int stale_camera = -1;
+    for (size_t i = 0; i < pipelines_.size() && stale_camera < 0; ++i)
+      if (pipelines_[i]->camera().forward() &&
+          watchdog_.health(depth_inputs_[i]) == StalenessWatchdog::STALE)
+        stale_camera = i;
+
+    speed_scale_ = worst == StalenessWatchdog::FRESH ? 1.0 : config.stale_speed_scale;
+
+    if (stale_camera >= 0)
+    {
+      if (!stopped_)
+      {
+        ROS_WARN("Depth images of %s are %.2fs old, stopping the robot",
+                 pipelines_[stale_camera]->camera().name.c_str(),
+                 watchdog_.age(depth_inputs_[stale_camera]));
+        events_.write(EVENT_STALE, depth_inputs_[stale_camera], watchdog_.age(depth_inputs_[stale_camera]));
+      }
+      stopped_ = true;
+      cmdpub_.publish(geometry_msgs::TwistPtr(new geometry_msgs::Twist()));
+      noteCommand(0.0, 0.0);
+    }
+    else
+    {
+      if (stopped_)
+      {
+        ROS_INFO("Depth images are back, resuming");
+        events_.write(EVENT_RESUME);
+      }
+      stopped_ = false;
     }
 
-    //X,Y,Z of the centroid
-    float x = 0.0;
-    float y = 0.0;
-    float z = 1e6;
-    //Number of points observed
-    unsigned int n = 0;
-
-    //Iterate through all the points in the region and find the average of the position
-    const float* depth_row = reinterpret_cast<const float*>(&depth_msg->data[0]);
-    int row_step = depth_msg->step / sizeof(float);
-    for (int v = 0; v < (int)depth_msg->height; ++v, depth_row += row_step)
+    if (faces == StalenessWatchdog::STALE && !following_marker_)
     {
-     for (int u = 0; u < (int)depth_msg->width; ++u)
-     {
-       float depth = depth_image_proc::DepthTraits<float>::toMeters(depth_row[u]);
-       if (!depth_image_proc::DepthTraits<float>::valid(depth) || depth > max_z_) continue;
-       float y_val = sin_pixel_y[v] * depth;
-       float x_val = sin_pixel_x[u] * depth;
-       if ( y_val > min_y_ && y_val < max_y_ &&
-            x_val > min_x_ && x_val < max_x_)
-       {
-         x += x_val;
-         y += y_val;
-         z = std::min(z, depth); //approximate depth as forward.
-         n++;
-       }
-     }
+      // Nobody else drives the state machine while the faces are down
+      if (logic_.faceFound())
+        events_.write(EVENT_STALE, faces_input_, watchdog_.age(faces_input_));
+      logic_.loseFace();
+      if (!stopped_)
+        updateState();
     }
-    if(n>4000){obstacle_detected = true;
-               ROS_INFO_THROTTLE(1, "OBSTACLE DETECTED\n");
-              }else{obstacle_detected=false;
-                 ROS_INFO_THROTTLE(1, "OBSTACLE NOT DETECTED\n");
-              }
+  }
+
+  /*!
+   * @brief Publish the state of the depth processing budgets and of
+   * the input watchdog.
+   */
+  void publishDiagnostics(const FollowerConfig& config)
+  {
+    diagnostic_msgs::DiagnosticArrayPtr array(new diagnostic_msgs::DiagnosticArray());
+    array->header.stamp = ros::Time::now();
+
+    for (size_t i = 0; i < pipelines_.size(); ++i)
+    {
+      diagnostic_msgs::DiagnosticStatus status;
+      status.name = getName() + ": " + pipelines_[i]->camera().name + " processing";
+      status.hardware_id = "none";
+      pipelines_[i]->diagnostics(status);
+      addValue(status, "budget_ms", config.budget_ms);
+      array->status.push_back(status);
+    }
+
+    static const char* health_names[] = {"fresh", "slow", "stale"};
+    for (size_t i = 0; i < watchdog_.size(); ++i)
+    {
+      diagnostic_msgs::DiagnosticStatus input;
+      input.name = getName() + ": " + watchdog_.name(i) + " input";
+      input.hardware_id = "none";
+      input.level = watchdog_.health(i) == StalenessWatchdog::FRESH
+                    ? diagnostic_msgs::DiagnosticStatus::OK
+                    : watchdog_.health(i) == StalenessWatchdog::SLOW
+                      ? diagnostic_msgs::DiagnosticStatus::WARN
+                      : diagnostic_msgs::DiagnosticStatus::ERROR;
+      input.message = health_names[watchdog_.health(i)];
+      addValue(input, "age", watchdog_.age(i));
+      addValue(input, "slow_violations", watchdog_.slowViolations(i));
+      addValue(input, "stop_violations", watchdog_.stopViolations(i));
+      array->status.push_back(input);
+    }
+
+    diagpub_.publish(array);
+  }
+
+  template<typename T>
+  static void addValue(diagnostic_msgs::DiagnosticStatus& status, const std::string& key, const T& value)
+  {
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = boost::lexical_cast<std::string>(value);
+    status.values.push_back(kv);
   }
 
 void keyboardCallback(const keyboard::Key key){
           if(key.code == 32){
-            ROS_INFO_THROTTLE(1, "KEY PRESSED\n");
+            events_.write(EVENT_KEY, key.code);
           }
   }
 
@@ -268,32 +776,147 @@ virtual void onInit()
     ros::NodeHandle& nh = getNodeHandle();
     ros::NodeHandle& private_nh = getPrivateNodeHandle();
 
-    private_nh.getParam("min_y", min_y_);
-    private_nh.getParam("max_y", max_y_);
-    private_nh.getParam("min_x", min_x_);
-    private_nh.getParam("max_x", max_x_);
-    private_nh.getParam("max_z", max_z_);
-    private_nh.getParam("goal_z", goal_z_);
-    private_nh.getParam("z_scale", z_scale_);
-    private_nh.getParam("x_scale", x_scale_);
     private_nh.getParam("enabled", enabled_);
+    private_nh.getParam("scan_range_min", scan_range_min_);
+    private_nh.getParam("scan_range_max", scan_range_max_);
+    private_nh.getParam("scan_frame_id", scan_frame_id_);
+    private_nh.getParam("faces_topic", faces_topic_);
+    private_nh.getParam("watchdog_rate", watchdog_rate_);
+
+    std::string event_log;
+    private_nh.getParam("event_log", event_log);
+    if (!event_log.empty() && !events_.open(event_log))
+      ROS_WARN("Cannot open the event log %s, events are not logged", event_log.c_str());
+
+    // Cameras read depth images, organized clouds in points mode, or
+    // depth compressed by the RVL encoder nodelet in rvl mode
+    std::string input_mode = "image";
+    private_nh.getParam("input_mode", input_mode);
+
+    // Without a camera list, a single forward camera on the usual topics
+    std::vector<std::string> camera_names;
+    private_nh.getParam("depth_cameras", camera_names);
+    std::vector<DepthCamera> cameras;
+    if (camera_names.empty())
+    {
+      DepthCamera camera;
+      camera.name = "depth";
+      camera.points = input_mode == "points";
+      camera.rvl = input_mode == "rvl";
+      camera.topic = depthTopic(input_mode);
+      camera.scan_topic = "scan";
+      camera.closing_topic = "closing_speed";
+      camera.ttc_topic = "time_to_collision";
+      camera.scan_frame_id = scan_frame_id_;
+      cameras.push_back(camera);
+    }
+    for (size_t i = 0; i < camera_names.size(); ++i)
+    {
+      ros::NodeHandle camera_nh(private_nh, camera_names[i]);
+      DepthCamera camera;
+      camera.name = camera_names[i];
+      std::string camera_mode = camera_nh.param("input_mode", input_mode);
+      camera.points = camera_mode == "points";
+      camera.rvl = camera_mode == "rvl";
+      camera.topic = camera_nh.param<std::string>("topic", camera.name + "/" + depthTopic(camera_mode));
+      camera.scan_topic = camera.name + "/scan";
+      camera.closing_topic = camera.name + "/closing_speed";
+      camera.ttc_topic = camera.name + "/time_to_collision";
+      camera.scan_frame_id = camera_nh.param<std::string>("scan_frame_id", camera.name + "_depth_frame");
+      camera.x = camera_nh.param("x", 0.0);
+      camera.y = camera_nh.param("y", 0.0);
+      camera.yaw = camera_nh.param("yaw", 0.0);
+      cameras.push_back(camera);
+    }
+
+    // Limits come from the configuration at the first check
+    for (size_t i = 0; i < cameras.size(); ++i)
+    {
+      cameras[i].scan_range_min = scan_range_min_;
+      cameras[i].scan_range_max = scan_range_max_;
+      pipelines_.push_back(boost::shared_ptr<DepthPipeline>(new DepthPipeline(cameras[i], settings_)));
+      depth_inputs_.push_back(watchdog_.addInput(cameras[i].name, 0.0, 0.0));
+    }
+    faces_input_ = watchdog_.addInput("faces", 0.0, 0.0);
+
+    // The search grids are centered on where odometry starts
+    GridGeometry geometry;
+    private_nh.getParam("search_grid_cells", geometry.cells);
+    double resolution = geometry.resolution;
+    private_nh.getParam("search_grid_resolution", resolution);
+    geometry.resolution = resolution;
+    visited_ = VisitedGrid(geometry);
+    heatmap_.reset(new SightingHeatmap(geometry));
+    std::string heatmap_file;
+    private_nh.getParam("heatmap_file", heatmap_file);
+    if (!heatmap_file.empty() && !heatmap_->open(heatmap_file))
+      ROS_WARN("Cannot map the sighting heatmap %s, sightings are kept in memory only",
+               heatmap_file.c_str());
 
     cmdpub_ = private_nh.advertise<geometry_msgs::Twist> ("cmd_vel", 1);
+    diagpub_ = nh.advertise<diagnostic_msgs::DiagnosticArray> ("/diagnostics", 1);
+    engagedpub_ = private_nh.advertise<std_msgs::Empty> ("engaged", 1);
+    // Latched, so face_roi gets the current rate whenever it (re)starts
+    detectorratepub_ = private_nh.advertise<std_msgs::Float32> ("detector_rate", 1, true);
+    private_nh.getParam("viz_rate", viz_rate_);
+    viz_.init(private_nh, viz_rate_);
+
+    // The server loads the box parameters and calls reconfigure() right
+    // away, so the callbacks below always find a configuration.
+    light_nh_ = nh;
+    light_nh_.setCallbackQueue(&light_queue_);
+    ros::NodeHandle& light_nh = light_nh_;
+    ros::NodeHandle control_nh(nh);
+    control_nh.setCallbackQueue(&control_queue_);
+    ros::NodeHandle control_private_nh(private_nh);
+    control_private_nh.setCallbackQueue(&control_queue_);
+
+    config_srv_ = new dynamic_reconfigure::Server<turtlebot_follower::FollowerConfig>(control_private_nh);
+    dynamic_reconfigure::Server<turtlebot_follower::FollowerConfig>::CallbackType f =
+        boost::bind(&TurtlebotFollower::reconfigure, this, _1, _2);
+    config_srv_->setCallback(f);
+    switch_srv_ = control_private_nh.advertiseService("change_state", &TurtlebotFollower::changeModeSrvCb, this);
 
-    sub_= nh.subscribe<sensor_msgs::Image>("depth/image_rect", 1, &TurtlebotFollower::updateObstacle, this);
+    // Each camera is processed on its own thread
+    for (size_t i = 0; i < pipelines_.size(); ++i)
+      pipelines_[i]->start(nh, private_nh);
 
-    facesSubscriber = nh.subscribe("/person_detection/faces", 100,  &TurtlebotFollower::personDetectionCallBack, this);
+    // Only the newest detection matters, older ones would only add latency
+    facesSubscriber = light_nh.subscribe(faces_topic_, 1,  &TurtlebotFollower::personDetectionCallBack, this);
+    last_face_time_ = ros::Time::now().toSec();
+    {
+      // Following may start off
+      boost::mutex::scoped_lock lock(state_mutex_);
+      applyProfile(boost::atomic_load(&settings_)->config, ResourceProfile());
+    }
 
-    keyboardSub = nh.subscribe("/keyboard/keydown", 100,  &TurtlebotFollower::keyboardCallback, this);
+    keyboardSub = control_nh.subscribe("/keyboard/keydown", 100,  &TurtlebotFollower::keyboardCallback, this);
 
-    //stateSub = nh.subscribe("/person_detection/faces", 100,  &TurtlebotFollower::updateState, this);
+    odomSub = light_nh.subscribe("odom", 10, &TurtlebotFollower::odomCb, this);
 
+    private_nh.getParam("marker_color", marker_color_);
+    if (!marker_color_.empty())
+    {
+      std::string blobs_topic = "/blob_segmenter/blobs";
+      private_nh.getParam("blobs_topic", blobs_topic);
+      blobsSubscriber = light_nh.subscribe(blobs_topic, 1, &TurtlebotFollower::blobsCb, this);
+    }
 
+    //stateSub = nh.subscribe("/person_detection/faces", 100,  &TurtlebotFollower::updateState, this);
 
-    config_srv_ = new dynamic_reconfigure::Server<turtlebot_follower::FollowerConfig>(private_nh);
-    dynamic_reconfigure::Server<turtlebot_follower::FollowerConfig>::CallbackType f =
-        boost::bind(&TurtlebotFollower::reconfigure, this, _1, _2);
-    config_srv_->setCallback(f);
+    watchdog_timer_ = light_nh.createTimer(ros::Duration(1.0 / watchdog_rate_), &TurtlebotFollower::watchdogCb, this);
+    search_decay_timer_ = control_nh.createTimer(ros::Duration(60.0), &TurtlebotFollower::searchDecayCb, this);
+
+    int light_threads = 1;
+    int control_threads = 1;
+    private_nh.getParam("light_threads", light_threads);
+    private_nh.getParam("control_threads", control_threads);
+    light_spinner_.reset(new ros::AsyncSpinner(std::max(light_threads, 1), &light_queue_));
+    light_spinner_->start();
+    control_spinner_.reset(new ros::AsyncSpinner(std::max(control_threads, 1), &control_queue_));
+    control_spinner_->start();
+    speech_spinner_.reset(new ros::AsyncSpinner(1, &speech_queue_));
+    speech_spinner_->start();
 
 
 
@@ -303,25 +926,33 @@ virtual void onInit()
 
   void reconfigure(turtlebot_follower::FollowerConfig &config, uint32_t level)
   {
-    min_y_ = config.min_y;
-    max_y_ = config.max_y;
-    min_x_ = config.min_x;
-    max_x_ = config.max_x;
-    max_z_ = config.max_z;
-    goal_z_ = config.goal_z;
-    z_scale_ = config.z_scale;
-    x_scale_ = config.x_scale;
+    // Build the new epoch completely before anyone can see it
+    FollowerSettingsConstPtr settings(new FollowerSettings(config, ++epoch_));
+    boost::atomic_store(&settings_, settings);
+    viz_.setSettings(*settings);
   }
 
 
-  ros::Subscriber sub_;
+  // The queues outlive the subscriptions and timers declared below them
+  ros::CallbackQueue light_queue_; /**< Faces, odometry and the watchdog */
+  ros::CallbackQueue control_queue_; /**< The keyboard, the services and housekeeping */
+  ros::CallbackQueue speech_queue_; /**< The greetings, one at a time */
+  boost::scoped_ptr<ros::AsyncSpinner> light_spinner_;
+  boost::scoped_ptr<ros::AsyncSpinner> control_spinner_;
+  boost::scoped_ptr<ros::AsyncSpinner> speech_spinner_;
+  ros::NodeHandle light_nh_; /**< Subscribes on light_queue_ */
+
   ros::Publisher cmdpub_;
-  ros::Publisher markerpub_;
-  ros::Publisher bboxpub_;
+  ros::Publisher diagpub_;
+  ros::Publisher engagedpub_;
+  ros::Publisher detectorratepub_;
   ros::Subscriber blobsSubscriber;
   ros::Subscriber facesSubscriber;
   ros::Subscriber keyboardSub;
   ros::Subscriber stateSub;
+  ros::Subscriber odomSub;
+  ros::Timer watchdog_timer_;
+  ros::Timer search_decay_timer_;
 };
 
 PLUGINLIB_DECLARE_CLASS(turtlebot_follower, TurtlebotFollower, turtlebot_follower::TurtlebotFollower, nodelet::Nodelet);
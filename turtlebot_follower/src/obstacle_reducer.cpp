@@ -0,0 +1,452 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "turtlebot_follower/obstacle_reducer.h"
+#include <depth_image_proc/depth_traits.h>
+#include <cstring>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace turtlebot_follower
+{
+
+namespace
+{
+
+inline float readFloat(const uint8_t* p)
+{
+  float value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+#if defined(__SSE2__)
+/*!
+ * @brief Reduce a row of packed xyz_ points four at a time.
+ * For clouds with a 16 byte point step and x, y, z at offsets 0, 4
+ * and 8, four points are four consecutive vectors that transpose into
+ * vectors of x, y and z. The tests are the same as for single points.
+ * @return The first column left for the scalar loop.
+ */
+int reducePackedRow(const float* row, int width, const FollowerConfig& config, const ObstacleBox& obstacle_box,
+                     float reach, float footprint, PolarHistogram& histogram, float& sum_x, float& sum_y,
+                     float& min_z, float& sum_z2, unsigned int& n)
+{
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 far = _mm_set1_ps(1e6f);
+  const __m128 v_reach = _mm_set1_ps(reach);
+  const __m128 v_max_z = _mm_set1_ps(obstacle_box.max_z);
+  const __m128 v_min_x = _mm_set1_ps(obstacle_box.min_x);
+  const __m128 v_max_x = _mm_set1_ps(obstacle_box.max_x);
+  const __m128 v_min_y = _mm_set1_ps(config.min_y);
+  const __m128 v_max_y = _mm_set1_ps(config.max_y);
+  const __m128 v_hist_range = _mm_set1_ps(config.histogram_range);
+  const __m128 v_one = _mm_set1_ps(1.0f);
+  const __m128 v_inv_range = _mm_set1_ps(1.0f / config.histogram_range);
+  const __m128 v_footprint = _mm_set1_ps(footprint);
+
+  __m128 acc_x = zero, acc_y = zero, acc_z = far, acc_z2 = zero;
+  __m128i acc_n = _mm_setzero_si128();
+  int u = 0;
+  for (; u + 4 <= width; u += 4)
+  {
+    __m128 x = _mm_loadu_ps(row + 4 * u);
+    __m128 y = _mm_loadu_ps(row + 4 * u + 4);
+    __m128 z = _mm_loadu_ps(row + 4 * u + 8);
+    __m128 w = _mm_loadu_ps(row + 4 * u + 12);
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+
+    // Optical frame y points down; NaN fails every comparison
+    __m128 y_up = _mm_sub_ps(zero, y);
+    __m128 valid = _mm_and_ps(_mm_cmpgt_ps(z, zero), _mm_cmple_ps(z, v_reach));
+    valid = _mm_and_ps(valid, _mm_and_ps(_mm_cmpgt_ps(y_up, v_min_y), _mm_cmplt_ps(y_up, v_max_y)));
+    if (_mm_movemask_ps(valid) == 0)
+      continue;
+
+    // Nearer points weigh more in the histogram
+    __m128 z2 = _mm_mul_ps(z, z);
+    int near = _mm_movemask_ps(_mm_and_ps(valid, _mm_cmplt_ps(z, v_hist_range)));
+    if (near)
+    {
+      float weight[4], lanes_z[4];
+      __m128 nearness = _mm_sub_ps(v_one, _mm_mul_ps(z, v_inv_range));
+      _mm_storeu_ps(weight, _mm_mul_ps(_mm_mul_ps(v_footprint, z2), nearness));
+      _mm_storeu_ps(lanes_z, z);
+      for (int k = 0; k < 4; ++k)
+        if (near & (1 << k))
+          histogram.addColumn(u + k, weight[k], lanes_z[k]);
+    }
+
+    __m128 box = _mm_and_ps(_mm_cmple_ps(z, v_max_z),
+                            _mm_and_ps(_mm_cmpgt_ps(x, v_min_x), _mm_cmplt_ps(x, v_max_x)));
+    box = _mm_and_ps(valid, box);
+    acc_x = _mm_add_ps(acc_x, _mm_and_ps(box, x));
+    acc_y = _mm_add_ps(acc_y, _mm_and_ps(box, y_up));
+    acc_z = _mm_min_ps(acc_z, _mm_or_ps(_mm_and_ps(box, z), _mm_andnot_ps(box, far)));
+    acc_z2 = _mm_add_ps(acc_z2, _mm_and_ps(box, z2));
+    // True lanes are -1
+    acc_n = _mm_sub_epi32(acc_n, _mm_castps_si128(box));
+  }
+
+  float lanes_x[4], lanes_y[4], lanes_z[4], lanes_z2[4];
+  int32_t lanes_n[4];
+  _mm_storeu_ps(lanes_x, acc_x);
+  _mm_storeu_ps(lanes_y, acc_y);
+  _mm_storeu_ps(lanes_z, acc_z);
+  _mm_storeu_ps(lanes_z2, acc_z2);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes_n), acc_n);
+  for (int k = 0; k < 4; ++k)
+  {
+    sum_x += lanes_x[k];
+    sum_y += lanes_y[k];
+    min_z = std::min(min_z, lanes_z[k]);
+    sum_z2 += lanes_z2[k];
+    n += lanes_n[k];
+  }
+  return u;
+}
+#endif
+
+} // namespace
+
+ObstacleReducer::ObstacleReducer() : applied_epoch_(0), row_begin_(0), row_end_(0)
+{
+}
+
+/*!
+ * @brief Check that a point cloud's data holds all the points its
+ * layout describes, so that reduceCloud() can read it in place.
+ * @return false if the rows overlap or the data is truncated.
+ */
+bool ObstacleReducer::holdsPoints(const sensor_msgs::PointCloud2& cloud)
+{
+  // Whole points of three floats, in rows that do not overlap
+  return cloud.width > 0 && cloud.point_step >= 3 * sizeof(float) &&
+         cloud.row_step >= (uint64_t)cloud.width * cloud.point_step &&
+         cloud.data.size() >= (uint64_t)cloud.row_step * cloud.height;
+}
+
+/*!
+ * @brief Find the x, y and z fields of a point cloud.
+ * @param offsets The byte offsets of x, y and z inside a point.
+ * @return false unless all three are little endian float32 values.
+ */
+bool ObstacleReducer::xyzOffsets(const sensor_msgs::PointCloud2& cloud, uint32_t offsets[3])
+{
+  static const char* names[3] = {"x", "y", "z"};
+  if (cloud.is_bigendian)
+    return false;
+  for (int i = 0; i < 3; ++i)
+  {
+    size_t f = 0;
+    while (f < cloud.fields.size() && cloud.fields[f].name != names[i]) ++f;
+    if (f == cloud.fields.size() ||
+        cloud.fields[f].datatype != sensor_msgs::PointField::FLOAT32 ||
+        cloud.fields[f].offset + sizeof(float) > cloud.point_step)
+      return false;
+    offsets[i] = cloud.fields[f].offset;
+  }
+  return true;
+}
+
+bool ObstacleReducer::prepare(uint32_t width, uint32_t height, const FollowerSettings& settings)
+{
+  const FollowerConfig& config = settings.config;
+  if (!config.denoise)
+    denoiser_.reset();
+  box_ = settings.box;
+
+  // The sin of each row and column only changes with the resolution
+  if (!rays_.resize(width, height) && settings.epoch == applied_epoch_)
+    return false;
+
+  if (histogram_.size() != config.histogram_sectors)
+    histogram_.configure(config.histogram_sectors, kHorizontalFov);
+  histogram_.bindColumns(rays_.bearing());
+  settings.rowBounds(rays_, row_begin_, row_end_);
+  applied_epoch_ = settings.epoch;
+  return true;
+}
+
+/*!
+ * @brief Reduce one depth image row into the laser scan.
+ * Keeps the closest range per column, measured along the ray in the
+ * horizontal plane.
+ */
+template<typename T>
+void ObstacleReducer::reduceScanRow(const T* depth_row, std::vector<float>& ranges)
+{
+  const std::vector<float>& cos_pixel_x = rays_.cosX();
+  const int width = ranges.size();
+  for (int u = 0; u < width; ++u)
+  {
+    if (!depth_image_proc::DepthTraits<T>::valid(depth_row[u])) continue;
+    float depth = depth_image_proc::DepthTraits<T>::toMeters(depth_row[u]);
+    float& range = ranges[width - 1 - u];
+    range = std::min(range, depth / cos_pixel_x[u]);
+  }
+}
+
+/*!
+ * @brief Reduce a depth image into the scan, obstacle box and histogram.
+ * With denoising on, the obstacle pass reads the filtered grid of the
+ * denoiser instead of the image itself.
+ */
+template<typename T>
+BoxStats ObstacleReducer::reduceImage(const T* depth_data, int row_step,
+                                       const FollowerSettings& settings, int stride,
+                                       std::vector<float>* ranges)
+{
+  const FollowerConfig& config = settings.config;
+  const int height = rays_.height();
+  histogram_.clear();
+  if (ranges)
+  {
+    int scan_top = std::max(0, height / 2 - config.scan_height / 2);
+    int scan_bottom = std::min(height, scan_top + config.scan_height);
+    for (int v = scan_top; v < scan_bottom; ++v)
+      reduceScanRow(depth_data + v * row_step, *ranges);
+  }
+
+  const T* first = depth_data + row_begin_ * row_step;
+  if (!config.denoise)
+  {
+    // Under a budget the pyramid would cost more than the samples it saves
+    if (stride > 1)
+      return reduceDepth(first, stride * row_step, stride, settings, stride, NULL);
+    pyramid_.build(first, row_step, rays_.width(), row_end_ - row_begin_);
+    return reduceDepth(first, row_step, 1, settings, 1, &pyramid_);
+  }
+
+  const int columns = (rays_.width() + stride - 1) / stride;
+  const int rows = (row_end_ - row_begin_ + stride - 1) / stride;
+  if (rows == 0)
+  {
+    BoxStats empty = {0, 0.0f, 0.0f, 1e6f, 0.0f};
+    return empty;
+  }
+  denoiser_.load(first, stride * row_step, stride, columns, rows);
+  denoiser_.filter(config.denoise_temporal);
+  return reduceDepth(denoiser_.row(0), denoiser_.width(), 1, settings, stride, NULL);
+}
+
+/*!
+ * @brief Reduce depth samples into the obstacle box and histogram.
+ * Walks the obstacle rows on the grid of the budget stride.
+ * @param data The sample of the first obstacle row and first column.
+ * @param row_pitch The distance between grid rows, in elements.
+ * @param pixel_pitch The distance between grid columns, in elements.
+ * @param settings The configuration of this frame.
+ * @param stride The pixel stride of the obstacle pass.
+ * @param pyramid The depth pyramid of the obstacle rows at stride 1, or NULL.
+ * @return The samples inside the box.
+ */
+template<typename T>
+BoxStats ObstacleReducer::reduceDepth(const T* data, int row_pitch, int pixel_pitch,
+                                      const FollowerSettings& settings, int stride,
+                                      const DepthPyramid* pyramid)
+{
+  const FollowerConfig& config = settings.config;
+  const std::vector<float>& sin_pixel_x = rays_.sinX();
+  const std::vector<float>& sin_pixel_y = rays_.sinY();
+  const float hist_range = config.histogram_range;
+  const T max_z = RawDepth<T>::maxZ(box_);
+  const T reach = RawDepth<T>::reach(settings);
+  const int width = rays_.width();
+
+  //X,Y,Z of the centroid
+  float x = 0.0;
+  float y = 0.0;
+  float z = 1e6;
+  //Number of points observed
+  unsigned int n = 0;
+  // Sum of their squared depths, the frontal area grows with it
+  float z2 = 0.0f;
+
+  // Under a budget every sampled point stands for stride x stride pixels
+  const float footprint = rays_.footprint() * stride * stride;
+
+  // Nothing within reach: clear without looking at any pixel
+  const int tile_level = 3, tile = 1 << tile_level;
+  if (pyramid && pyramid->levels() <= tile_level)
+    pyramid = NULL;
+  if (pyramid && !pyramid->anyCloser(0, 0, width, row_end_ - row_begin_, settings.reach_mm + 1))
+  {
+    BoxStats clear = {0, 0.0f, 0.0f, 1e6f, 0.0f};
+    return clear;
+  }
+
+  //Iterate through all the points in the region and find the average of the position
+  const T* depth_row = data;
+  for (int v = row_begin_; v < row_end_; v += stride, depth_row += row_pitch)
+  {
+   for (int begin = 0, end = 0; begin < width; begin = end)
+   {
+    // Walk runs of tiles with depth in reach, skipping the rest
+    end = width;
+    if (pyramid)
+    {
+      const int tile_row = (v - row_begin_) / tile;
+      int x = begin / tile;
+      while (x * tile < width && pyramid->minAt(tile_level, x, tile_row) > settings.reach_mm)
+        ++x;
+      begin = std::min(x * tile, width);
+      while (x * tile < width && pyramid->minAt(tile_level, x, tile_row) <= settings.reach_mm)
+        ++x;
+      end = std::min(x * tile, width);
+    }
+    const T* sample = depth_row + begin / stride * pixel_pitch;
+    for (int u = begin; u < end; u += stride, sample += pixel_pitch)
+    {
+     T raw = *sample;
+     if (!depth_image_proc::DepthTraits<T>::valid(raw) || raw > reach) continue;
+     float depth = depth_image_proc::DepthTraits<T>::toMeters(raw);
+     float y_val = sin_pixel_y[v] * depth;
+     if (y_val <= config.min_y || y_val >= config.max_y) continue;
+     // Nearer points weigh more in the histogram
+     if (depth < hist_range)
+       histogram_.addColumn(u, footprint * depth * depth * (1.0f - depth / hist_range), depth);
+     if (raw > max_z) continue;
+     float x_val = sin_pixel_x[u] * depth;
+     if (x_val > box_.min_x && x_val < box_.max_x)
+     {
+       x += x_val;
+       y += y_val;
+       z = std::min(z, depth); //approximate depth as forward.
+       z2 += depth * depth;
+       n++;
+     }
+    }
+   }
+  }
+  BoxStats stats = {n, x, y, z, z2 * footprint};
+  return stats;
+}
+
+/*!
+ * @brief Reduce an organized point cloud into the obstacle box and histogram.
+ * Reads the points in place through the field offsets; packed clouds
+ * at full resolution take the vectorized path.
+ * @param cloud The cloud.
+ * @param offsets The byte offsets of x, y and z inside a point.
+ * @param settings The configuration of this frame.
+ * @param stride The pixel stride of the obstacle pass.
+ * @param ranges The laser scan ranges to fill, or NULL.
+ * @return The samples inside the box.
+ */
+BoxStats ObstacleReducer::reduceCloud(const sensor_msgs::PointCloud2& cloud,
+                                      const uint32_t offsets[3],
+                                      const FollowerSettings& settings, int stride,
+                                      std::vector<float>* ranges)
+{
+  const FollowerConfig& config = settings.config;
+  const float hist_range = config.histogram_range;
+  const float max_z = box_.max_z;
+  const float reach = settings.reach;
+  // Single precision limits, like the vectorized path
+  const float min_x = box_.min_x, max_x = box_.max_x;
+  const float min_y = config.min_y, max_y = config.max_y;
+  const int width = cloud.width;
+  const uint32_t point_step = cloud.point_step;
+  const uint8_t* data = &cloud.data[0];
+
+  histogram_.clear();
+  if (ranges)
+  {
+    int scan_top = std::max(0, (int)cloud.height / 2 - config.scan_height / 2);
+    int scan_bottom = std::min((int)cloud.height, scan_top + config.scan_height);
+    for (int v = scan_top; v < scan_bottom; ++v)
+    {
+      const uint8_t* point = data + v * cloud.row_step;
+      for (int u = 0; u < width; ++u, point += point_step)
+      {
+        float z = readFloat(point + offsets[2]);
+        if (!(z > 0.0f)) continue;
+        float x = readFloat(point + offsets[0]);
+        float& range = (*ranges)[width - 1 - u];
+        range = std::min(range, std::sqrt(x * x + z * z));
+      }
+    }
+  }
+
+  float x = 0.0;
+  float y = 0.0;
+  float z = 1e6;
+  float z2 = 0.0f;
+  unsigned int n = 0;
+
+  const float footprint = rays_.footprint() * stride * stride;
+#if defined(__SSE2__)
+  const bool packed = stride == 1 && point_step == 16 &&
+                      offsets[0] == 0 && offsets[1] == 4 && offsets[2] == 8;
+#endif
+
+  for (int v = row_begin_; v < row_end_; v += stride)
+  {
+    const uint8_t* row = data + v * cloud.row_step;
+    int u = 0;
+#if defined(__SSE2__)
+    if (packed)
+      u = reducePackedRow(reinterpret_cast<const float*>(row), width, config, box_, reach,
+                          footprint, histogram_, x, y, z, z2, n);
+#endif
+    for (; u < width; u += stride)
+    {
+      const uint8_t* point = row + u * point_step;
+      // Invalid points are NaN
+      float depth = readFloat(point + offsets[2]);
+      if (!(depth > 0.0f) || depth > reach) continue;
+      // Optical frame y points down
+      float y_val = -readFloat(point + offsets[1]);
+      if (y_val <= min_y || y_val >= max_y) continue;
+      if (depth < hist_range)
+        histogram_.addColumn(u, footprint * depth * depth * (1.0f - depth / hist_range), depth);
+      if (depth > max_z) continue;
+      float x_val = readFloat(point + offsets[0]);
+      if (x_val > min_x && x_val < max_x)
+      {
+        x += x_val;
+        y += y_val;
+        z = std::min(z, depth);
+        z2 += depth * depth;
+        n++;
+      }
+    }
+  }
+  BoxStats stats = {n, x, y, z, z2 * footprint};
+  return stats;
+}
+
+template BoxStats ObstacleReducer::reduceImage<uint16_t>(const uint16_t*, int, const FollowerSettings&,
+                                                        int, std::vector<float>*);
+template BoxStats ObstacleReducer::reduceImage<float>(const float*, int, const FollowerSettings&,
+                                                     int, std::vector<float>*);
+
+} // namespace turtlebot_follower
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <ros/ros.h>
+#include <pluginlib/class_list_macros.h>
+#include <nodelet/nodelet.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/CompressedImage.h>
+#include <sensor_msgs/image_encodings.h>
+#include "turtlebot_follower/rvl_codec.h"
+
+namespace turtlebot_follower
+{
+
+//* RVL compression of depth images for the follower off the robot.
+/**
+ * Runs in the camera's nodelet manager and republishes every depth
+ * image as an RVL compressed sensor_msgs/CompressedImage, so that a
+ * follower on another machine (input_mode rvl) gets lossless depth
+ * at a fraction of the bandwidth of raw images. Float depth is sent
+ * as millimeters, like 16 bit depth; images are only compressed
+ * while someone subscribes.
+ */
+class RvlEncoderNodelet : public nodelet::Nodelet
+{
+private:
+  RvlEncoder encoder_;
+
+  virtual void onInit()
+  {
+    ros::NodeHandle& private_nh = getPrivateNodeHandle();
+    rvl_pub_ = private_nh.advertise<sensor_msgs::CompressedImage>("rvl", 1);
+    image_sub_ = private_nh.subscribe<sensor_msgs::Image>("image", 1, &RvlEncoderNodelet::imageCb, this);
+  }
+
+  void imageCb(const sensor_msgs::ImageConstPtr& image)
+  {
+    if (rvl_pub_.getNumSubscribers() == 0)
+      return;
+
+    sensor_msgs::CompressedImagePtr msg(new sensor_msgs::CompressedImage());
+    msg->header = image->header;
+    msg->format = kRvlFormat;
+    const std::string& encoding = image->encoding;
+    if (encoding == sensor_msgs::image_encodings::TYPE_16UC1 ||
+        encoding == sensor_msgs::image_encodings::MONO16)
+      encoder_.encode(reinterpret_cast<const uint16_t*>(&image->data[0]), image->step / sizeof(uint16_t),
+                      image->width, image->height, msg->data);
+    else if (encoding == sensor_msgs::image_encodings::TYPE_32FC1)
+      encoder_.encode(reinterpret_cast<const float*>(&image->data[0]), image->step / sizeof(float),
+                      image->width, image->height, msg->data);
+    else
+    {
+      ROS_ERROR_THROTTLE(5, "Cannot compress depth images with encoding [%s]", encoding.c_str());
+      return;
+    }
+    rvl_pub_.publish(msg);
+  }
+
+  ros::Publisher rvl_pub_;
+  ros::Subscriber image_sub_;
+};
+
+PLUGINLIB_DECLARE_CLASS(turtlebot_follower, RvlEncoder, turtlebot_follower::RvlEncoderNodelet, nodelet::Nodelet);
+
+}
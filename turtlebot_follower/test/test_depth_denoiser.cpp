@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/random.hpp>
+#include <limits>
+#include "turtlebot_follower/depth_denoiser.h"
+
+using turtlebot_follower::DepthDenoiser;
+
+namespace
+{
+
+/** Depth in millimeters as the denoiser keeps it. */
+uint16_t millimeters(uint16_t depth)
+{
+  return depth == 0 || depth > DepthDenoiser::kFar ? (uint16_t)DepthDenoiser::kFar : depth;
+}
+
+/** The 3x3 median of a grid with replicated edges, by sorting. */
+std::vector<uint16_t> referenceMedian(const std::vector<uint16_t>& grid, int width, int height)
+{
+  std::vector<uint16_t> out(grid.size());
+  for (int v = 0; v < height; ++v)
+    for (int u = 0; u < width; ++u)
+    {
+      std::vector<uint16_t> window;
+      for (int dv = -1; dv <= 1; ++dv)
+        for (int du = -1; du <= 1; ++du)
+        {
+          int su = std::min(std::max(u + du, 0), width - 1);
+          int sv = std::min(std::max(v + dv, 0), height - 1);
+          window.push_back(grid[sv * width + su]);
+        }
+      std::sort(window.begin(), window.end());
+      out[v * width + u] = window[4];
+    }
+  return out;
+}
+
+/** Random depth with holes and readings past kFar. */
+std::vector<uint16_t> randomFrame(boost::mt19937& rng, int size)
+{
+  boost::uniform_int<int> depth(0, 0xffff);
+  boost::uniform_int<int> kind(0, 9);
+  std::vector<uint16_t> frame(size);
+  for (int i = 0; i < size; ++i)
+  {
+    int k = kind(rng);
+    frame[i] = k == 0 ? 0 : k == 1 ? (uint16_t)depth(rng) : (uint16_t)(depth(rng) % 4000);
+  }
+  return frame;
+}
+
+void expectRows(const DepthDenoiser& denoiser, const std::vector<uint16_t>& expected, int width, int height)
+{
+  for (int v = 0; v < height; ++v)
+    for (int u = 0; u < width; ++u)
+      ASSERT_EQ(expected[v * width + u], denoiser.row(v)[u]) << "at " << u << ", " << v;
+}
+
+} // namespace
+
+// Widths both multiples of the vector width and not, and a single column
+TEST(DepthDenoiser, SpatialMatchesSort)
+{
+  const int sizes[][2] = {{64, 8}, {37, 11}, {8, 1}, {1, 5}, {7, 3}};
+  boost::mt19937 rng(1);
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+  {
+    const int width = sizes[s][0], height = sizes[s][1];
+    DepthDenoiser denoiser;
+    for (int frame = 0; frame < 4; ++frame)
+    {
+      std::vector<uint16_t> depth = randomFrame(rng, width * height);
+      denoiser.load(&depth[0], width, 1, width, height);
+      denoiser.filter(false);
+
+      std::vector<uint16_t> grid(depth.size());
+      std::transform(depth.begin(), depth.end(), grid.begin(), millimeters);
+      expectRows(denoiser, referenceMedian(grid, width, height), width, height);
+    }
+  }
+}
+
+TEST(DepthDenoiser, TemporalMatchesSort)
+{
+  const int width = 45, height = 6;
+  boost::mt19937 rng(2);
+  DepthDenoiser denoiser;
+  std::vector<std::vector<uint16_t> > frames;
+  for (int frame = 0; frame < 6; ++frame)
+  {
+    std::vector<uint16_t> depth = randomFrame(rng, width * height);
+    std::transform(depth.begin(), depth.end(), depth.begin(), millimeters);
+    frames.push_back(depth);
+    denoiser.load(&depth[0], width, 1, width, height);
+    denoiser.filter(true);
+
+    // Until three frames arrived only the spatial median applies
+    std::vector<uint16_t> grid = depth;
+    if (frames.size() >= 3)
+      for (int i = 0; i < width * height; ++i)
+      {
+        uint16_t p[3] = {frames[frame][i], frames[frame - 1][i], frames[frame - 2][i]};
+        std::sort(p, p + 3);
+        grid[i] = p[1];
+      }
+    expectRows(denoiser, referenceMedian(grid, width, height), width, height);
+  }
+
+  // After a reset the history builds up again
+  denoiser.reset();
+  denoiser.load(&frames[0][0], width, 1, width, height);
+  denoiser.filter(true);
+  expectRows(denoiser, referenceMedian(frames[0], width, height), width, height);
+}
+
+TEST(DepthDenoiser, SamplesFloatImages)
+{
+  // Every other pixel of every third row of a float image
+  const int width = 10, height = 4, row_pitch = 3 * 2 * width;
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  std::vector<float> image(row_pitch * height, nan);
+  std::vector<uint16_t> expected(width * height);
+  for (int v = 0; v < height; ++v)
+    for (int u = 0; u < width; ++u)
+    {
+      float depth = (v * width + u) % 7 == 0 ? nan : 0.5f + 0.1f * u + v;
+      image[v * row_pitch + 2 * u] = depth;
+      expected[v * width + u] = depth == depth ? (uint16_t)(depth * 1000.0f + 0.5f) :
+                                                 (uint16_t)DepthDenoiser::kFar;
+    }
+
+  DepthDenoiser denoiser;
+  denoiser.load(&image[0], row_pitch, 2, width, height);
+  denoiser.filter(false);
+  expectRows(denoiser, referenceMedian(expected, width, height), width, height);
+}
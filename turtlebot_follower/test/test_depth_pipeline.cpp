@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+#include <ros/ros.h>
+#include <sensor_msgs/image_encodings.h>
+#include "turtlebot_follower/depth_pipeline.h"
+
+namespace turtlebot_follower
+{
+
+//* Feeds frames straight into the callbacks of a started pipeline.
+class DepthPipelineTest : public testing::Test
+{
+protected:
+  DepthPipelineTest() : settings_(new FollowerSettings(FollowerConfig::__getDefault__(), 1))
+  {
+    camera_.name = "test";
+    camera_.rvl = true;
+    camera_.topic = "depth_pipeline_test/depth/image_rect/rvl";
+    camera_.scan_topic = "scan";
+    camera_.scan_frame_id = "camera_depth_frame";
+    camera_.closing_topic = "closing_speed";
+    camera_.ttc_topic = "time_to_collision";
+    pipeline_.reset(new DepthPipeline(camera_, settings_));
+    ros::NodeHandle nh, private_nh("~");
+    pipeline_->start(nh, private_nh);
+  }
+
+  /** A compressed frame of a wall at 2 m, stamped at stamp or unstamped for 0. */
+  sensor_msgs::CompressedImagePtr rvlFrame(double stamp, uint32_t seq)
+  {
+    std::vector<uint16_t> depth(kWidth * kHeight, 2000);
+    sensor_msgs::CompressedImagePtr msg(new sensor_msgs::CompressedImage());
+    msg->header.seq = seq;
+    if (stamp > 0.0)
+      msg->header.stamp = ros::Time(stamp);
+    msg->format = kRvlFormat;
+    encoder_.encode(&depth[0], kWidth, kWidth, kHeight, msg->data);
+    return msg;
+  }
+
+  void feed(const sensor_msgs::CompressedImageConstPtr& msg) { pipeline_->rvlCb(msg); }
+  void feed(const sensor_msgs::ImageConstPtr& msg) { pipeline_->depthCb(msg); }
+
+  static const uint32_t kWidth = 64;
+  static const uint32_t kHeight = 48;
+
+  FollowerSettingsConstPtr settings_;
+  DepthCamera camera_;
+  boost::scoped_ptr<DepthPipeline> pipeline_;
+  RvlEncoder encoder_;
+};
+
+TEST_F(DepthPipelineTest, CorruptRvlFramesLeaveTheInputStale)
+{
+  // The header is fine, the code words are cut short
+  sensor_msgs::CompressedImagePtr corrupt = rvlFrame(100.0, 1);
+  corrupt->data.resize(16);
+  feed(corrupt);
+  EXPECT_FALSE(pipeline_->obstacles().processed);
+  EXPECT_EQ(0.0, pipeline_->obstacles().stamp);
+
+  feed(rvlFrame(101.0, 2));
+  EXPECT_TRUE(pipeline_->obstacles().processed);
+  EXPECT_DOUBLE_EQ(101.0, pipeline_->obstacles().stamp);
+
+  corrupt = rvlFrame(102.0, 3);
+  corrupt->data.resize(16);
+  feed(corrupt);
+  EXPECT_DOUBLE_EQ(101.0, pipeline_->obstacles().stamp);
+}
+
+TEST_F(DepthPipelineTest, UnsupportedEncodingsLeaveTheInputStale)
+{
+  sensor_msgs::ImagePtr image(new sensor_msgs::Image());
+  image->header.stamp = ros::Time(100.0);
+  image->width = kWidth;
+  image->height = kHeight;
+  image->encoding = sensor_msgs::image_encodings::RGB8;
+  image->step = 3 * kWidth;
+  image->data.assign(image->step * kHeight, 0);
+  feed(image);
+  EXPECT_FALSE(pipeline_->obstacles().processed);
+  EXPECT_EQ(0.0, pipeline_->obstacles().stamp);
+}
+
+TEST_F(DepthPipelineTest, UnstampedFramesPassTheRateCap)
+{
+  // Paced by the time they arrive rather than all at time zero
+  pipeline_->setRate(5.0);
+  feed(rvlFrame(0.0, 1));
+  EXPECT_TRUE(pipeline_->obstacles().processed);
+  EXPECT_GT(pipeline_->obstacles().stamp, 0.0);
+}
+
+} // namespace turtlebot_follower
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::init(argc, argv, "depth_pipeline_test");
+  return RUN_ALL_TESTS();
+}
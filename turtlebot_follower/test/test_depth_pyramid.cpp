@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/random.hpp>
+#include <limits>
+#include "turtlebot_follower/depth_pyramid.h"
+
+using turtlebot_follower::DepthPyramid;
+
+namespace
+{
+
+/** Depth in millimeters as the pyramid keeps it. */
+int millimeters(uint16_t depth)
+{
+  return depth == 0 || depth > DepthPyramid::kFar ? (int)DepthPyramid::kFar : depth;
+}
+
+int millimeters(float depth)
+{
+  return depth > 0.0f && depth < DepthPyramid::kFar / 1000.0f ? (int)(depth * 1000.0f + 0.5f) :
+                                                                (int)DepthPyramid::kFar;
+}
+
+/** The closest depth of [u0, u1) x [v0, v1) clipped to the window, by a full scan. */
+int scanClosest(const std::vector<int>& depth, int width, int height, int u0, int v0, int u1, int v1)
+{
+  int closest = DepthPyramid::kFar;
+  for (int v = std::max(v0, 0); v < std::min(v1, height); ++v)
+    for (int u = std::max(u0, 0); u < std::min(u1, width); ++u)
+      closest = std::min(closest, depth[v * width + u]);
+  return closest;
+}
+
+/** Compare every level and random region queries with full scans. */
+void expectScans(const DepthPyramid& pyramid, const std::vector<int>& depth, int width, int height,
+                 boost::mt19937& rng)
+{
+  for (int level = 0; level < pyramid.levels(); ++level)
+  {
+    const int size = 1 << level;
+    for (int y = 0; y * size < height; ++y)
+      for (int x = 0; x * size < width; ++x)
+        ASSERT_EQ(scanClosest(depth, width, height, x * size, y * size, (x + 1) * size, (y + 1) * size),
+                  pyramid.minAt(level, x, y)) << "level " << level << " at " << x << ", " << y;
+  }
+
+  // Regions partly or entirely outside the window, and empty ones
+  boost::uniform_int<int> u(-3, width + 3), v(-3, height + 3);
+  for (int i = 0; i < 500; ++i)
+  {
+    const int u0 = u(rng), v0 = v(rng), u1 = u(rng), v1 = v(rng);
+    const bool empty = std::min(u1, width) <= std::max(u0, 0) || std::min(v1, height) <= std::max(v0, 0);
+    const int closest = scanClosest(depth, width, height, u0, v0, u1, v1);
+    const int thresholds[] = {closest, closest + 1, closest - 1, 0, DepthPyramid::kFar + 1};
+    for (size_t t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); ++t)
+      ASSERT_EQ(!empty && closest < thresholds[t], pyramid.anyCloser(u0, v0, u1, v1, thresholds[t]))
+          << "[" << u0 << ", " << u1 << ") x [" << v0 << ", " << v1 << ") closer than " << thresholds[t];
+  }
+}
+
+} // namespace
+
+// Widths both multiples of the vector width and not, a single row or
+// column, and rows wider than the window
+TEST(DepthPyramid, MatchesFullScan)
+{
+  const int sizes[][3] = {{64, 32, 64}, {640, 40, 640}, {37, 13, 40}, {1, 9, 1}, {33, 1, 33}, {1, 1, 1}};
+  boost::mt19937 rng(1);
+  boost::uniform_int<int> any(0, 0xffff), near(300, 4000), kind(0, 9);
+  DepthPyramid pyramid;
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+  {
+    const int width = sizes[s][0], height = sizes[s][1], row_step = sizes[s][2];
+    for (int frame = 0; frame < 3; ++frame)
+    {
+      // Mostly far with a few holes and near points, as in a clear view
+      std::vector<uint16_t> image(row_step * height, 0);
+      std::vector<int> depth(width * height);
+      for (int v = 0; v < height; ++v)
+        for (int u = 0; u < width; ++u)
+        {
+          int k = kind(rng);
+          uint16_t d = k == 0 ? 0 : k == 1 ? (uint16_t)near(rng) : (uint16_t)any(rng);
+          image[v * row_step + u] = d;
+          depth[v * width + u] = millimeters(d);
+        }
+      pyramid.build(&image[0], row_step, width, height);
+      ASSERT_EQ(width, pyramid.width());
+      ASSERT_EQ(height, pyramid.height());
+      expectScans(pyramid, depth, width, height, rng);
+    }
+  }
+}
+
+TEST(DepthPyramid, MatchesFullScanOfFloats)
+{
+  const int width = 50, height = 20;
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  boost::mt19937 rng(2);
+  boost::uniform_real<float> meters(0.0f, 40.0f);
+  boost::uniform_int<int> kind(0, 9);
+  std::vector<float> image(width * height);
+  std::vector<int> depth(width * height);
+  for (int i = 0; i < width * height; ++i)
+  {
+    int k = kind(rng);
+    image[i] = k == 0 ? nan : k == 1 ? -1.0f : meters(rng);
+    depth[i] = millimeters(image[i]);
+  }
+  DepthPyramid pyramid;
+  pyramid.build(&image[0], width, width, height);
+  expectScans(pyramid, depth, width, height, rng);
+}
+
+TEST(DepthPyramid, ClearViewHasNothingCloser)
+{
+  const int width = 640, height = 40;
+  std::vector<uint16_t> image(width * height, 3000);
+  DepthPyramid pyramid;
+  pyramid.build(&image[0], width, width, height);
+  EXPECT_FALSE(pyramid.anyCloser(0, 0, width, height, 3000));
+
+  // One pixel in the corner is found, and only in regions holding it
+  image[(height - 1) * width + width - 1] = 500;
+  pyramid.build(&image[0], width, width, height);
+  EXPECT_TRUE(pyramid.anyCloser(0, 0, width, height, 3000));
+  EXPECT_FALSE(pyramid.anyCloser(0, 0, width - 1, height, 3000));
+  EXPECT_FALSE(pyramid.anyCloser(0, 0, width, height, 500));
+}
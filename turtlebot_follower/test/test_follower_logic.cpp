@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+#include "turtlebot_follower/follower_logic.h"
+
+using turtlebot_follower::FollowerConfig;
+using turtlebot_follower::FollowerLogic;
+
+// The robot stands still through the greeting, even if the person steps
+// back or comes up as an obstacle, and only a lost face ends it early
+TEST(FollowerLogic, GreetingHoldsEngageWhileTheFaceIsInView)
+{
+  const FollowerConfig config = FollowerConfig::__getDefault__();
+  FollowerLogic logic;
+  double linear, angular;
+  logic.seeFace(320.0, 240.0, 150.0);
+  ASSERT_EQ(FollowerLogic::ENGAGE, logic.decide(config, linear, angular));
+  logic.setGreeting(true);
+
+  logic.seeFace(400.0, 240.0, 60.0);
+  EXPECT_EQ(FollowerLogic::ENGAGE, logic.decide(config, linear, angular));
+  EXPECT_EQ(0.0, linear);
+  EXPECT_EQ(0.0, angular);
+  EXPECT_TRUE(logic.goal().stop);
+
+  logic.setObstacles(config, true, false, NULL);
+  EXPECT_EQ(FollowerLogic::ENGAGE, logic.decide(config, linear, angular));
+  EXPECT_TRUE(logic.goal().stop);
+
+  logic.loseFace();
+  EXPECT_EQ(FollowerLogic::AVOID_OBSTACLE, logic.decide(config, linear, angular));
+
+  // Once the greeting is over a distant face is approached again
+  logic.setGreeting(false);
+  logic.setObstacles(config, false, false, NULL);
+  logic.seeFace(320.0, 240.0, 60.0);
+  EXPECT_EQ(FollowerLogic::MOVE_TO_HUMAN, logic.decide(config, linear, angular));
+  EXPECT_GT(linear, 0.0);
+}
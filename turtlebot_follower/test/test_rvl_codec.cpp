@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2011, Willow Garage, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *     * Neither the name of the Willow Garage, Inc. nor the names of its
+ *       contributors may be used to endorse or promote products derived from
+ *       this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/random.hpp>
+#include <limits>
+#include "turtlebot_follower/rvl_codec.h"
+
+using turtlebot_follower::RvlDecoder;
+using turtlebot_follower::RvlEncoder;
+
+namespace
+{
+
+/** Depth with holes, smooth surfaces and jumps across the whole range. */
+std::vector<uint16_t> randomImage(boost::mt19937& rng, int row_step, int width, int height)
+{
+  boost::uniform_int<int> any(0, 0xffff), kind(0, 19), step(-3, 3);
+  std::vector<uint16_t> image(row_step * height, 0xdead);
+  int depth = 1000;
+  for (int v = 0; v < height; ++v)
+    for (int u = 0; u < width; ++u)
+    {
+      int k = kind(rng);
+      if (k == 0)
+        depth = any(rng);
+      else if (k > 14)
+        depth = std::min(std::max(depth + step(rng), 1), 0xffff);
+      image[v * row_step + u] = k < 3 ? 0 : (uint16_t)depth;
+    }
+  return image;
+}
+
+void expectDecoded(const RvlDecoder& decoder, const std::vector<uint16_t>& image, int row_step,
+                   int width, int height)
+{
+  ASSERT_EQ((uint32_t)width, decoder.width());
+  ASSERT_EQ((uint32_t)height, decoder.height());
+  for (int v = 0; v < height; ++v)
+    for (int u = 0; u < width; ++u)
+      ASSERT_EQ(image[v * row_step + u], decoder.depth()[v * width + u]) << "at " << u << ", " << v;
+}
+
+/** The stream of raw code values behind a header, in RvlEncoder's nibble code. */
+std::vector<uint8_t> codeStream(uint32_t width, uint32_t height, const std::vector<uint32_t>& values)
+{
+  std::vector<uint32_t> words;
+  words.push_back(width);
+  words.push_back(height);
+  uint32_t bits = 0;
+  int nibbles = 0;
+  for (size_t i = 0; i < values.size(); ++i)
+  {
+    uint32_t value = values[i];
+    do
+    {
+      uint32_t nibble = value & 7;
+      value >>= 3;
+      bits = (bits << 4) | nibble | (value ? 8 : 0);
+      if (++nibbles == 8)
+      {
+        words.push_back(bits);
+        bits = 0;
+        nibbles = 0;
+      }
+    } while (value);
+  }
+  if (nibbles)
+    words.push_back(bits << 4 * (8 - nibbles));
+  std::vector<uint8_t> data(words.size() * sizeof(uint32_t));
+  memcpy(&data[0], &words[0], data.size());
+  return data;
+}
+
+} // namespace
+
+// Row padding is dropped; odd sizes end the code in a partial word
+TEST(RvlCodec, RoundTripsShorts)
+{
+  const int sizes[][3] = {{640, 480, 640}, {37, 13, 40}, {1, 1, 1}, {1, 9, 1}, {33, 1, 33}};
+  boost::mt19937 rng(1);
+  RvlEncoder encoder;
+  RvlDecoder decoder;
+  std::vector<uint8_t> data;
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+  {
+    const int width = sizes[s][0], height = sizes[s][1], row_step = sizes[s][2];
+    std::vector<uint16_t> image = randomImage(rng, row_step, width, height);
+    encoder.encode(&image[0], row_step, width, height, data);
+
+    uint32_t peek_width, peek_height;
+    ASSERT_TRUE(RvlDecoder::peek(data, peek_width, peek_height));
+    EXPECT_EQ((uint32_t)width, peek_width);
+    EXPECT_EQ((uint32_t)height, peek_height);
+    ASSERT_TRUE(decoder.decode(data));
+    expectDecoded(decoder, image, row_step, width, height);
+  }
+}
+
+TEST(RvlCodec, RoundTripsExtremes)
+{
+  const int width = 64, height = 4;
+  std::vector<uint16_t> image(width * height);
+  RvlEncoder encoder;
+  RvlDecoder decoder;
+  std::vector<uint8_t> data;
+
+  // All missing, all the same, and the largest jumps both ways
+  const uint16_t fills[] = {0, 1, 0xffff};
+  for (size_t f = 0; f < sizeof(fills) / sizeof(fills[0]); ++f)
+  {
+    std::fill(image.begin(), image.end(), fills[f]);
+    encoder.encode(&image[0], width, width, height, data);
+    ASSERT_TRUE(decoder.decode(data));
+    expectDecoded(decoder, image, width, width, height);
+  }
+  for (int i = 0; i < width * height; ++i)
+    image[i] = i % 2 ? 1 : 0xffff;
+  encoder.encode(&image[0], width, width, height, data);
+  ASSERT_TRUE(decoder.decode(data));
+  expectDecoded(decoder, image, width, width, height);
+}
+
+TEST(RvlCodec, RoundTripsFloatsInMillimeters)
+{
+  const int width = 20, height = 3;
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  std::vector<float> image(width * height);
+  std::vector<uint16_t> expected(width * height);
+  for (int i = 0; i < width * height; ++i)
+  {
+    image[i] = i % 5 == 0 ? nan : i % 7 == 0 ? -1.0f : i % 11 == 0 ? 70.0f : 0.4f + 0.0137f * i;
+    expected[i] = image[i] > 0.0f && image[i] < 65.535f ? (uint16_t)(image[i] * 1000.0f + 0.5f) : 0;
+  }
+
+  RvlEncoder encoder;
+  RvlDecoder decoder;
+  std::vector<uint8_t> data;
+  encoder.encode(&image[0], width, width, height, data);
+  ASSERT_TRUE(decoder.decode(data));
+  expectDecoded(decoder, expected, width, width, height);
+}
+
+TEST(RvlCodec, ReusesTheDepthBuffer)
+{
+  const int width = 64, height = 48;
+  boost::mt19937 rng(2);
+  RvlEncoder encoder;
+  RvlDecoder decoder;
+  std::vector<uint8_t> data;
+  std::vector<uint16_t> image = randomImage(rng, width, width, height);
+  encoder.encode(&image[0], width, width, height, data);
+  ASSERT_TRUE(decoder.decode(data));
+  const uint16_t* buffer = decoder.depth();
+
+  // Smaller images and same size ones decode in place
+  std::vector<uint16_t> small = randomImage(rng, 10, 10, 10);
+  encoder.encode(&small[0], 10, 10, 10, data);
+  ASSERT_TRUE(decoder.decode(data));
+  expectDecoded(decoder, small, 10, 10, 10);
+  image = randomImage(rng, width, width, height);
+  encoder.encode(&image[0], width, width, height, data);
+  ASSERT_TRUE(decoder.decode(data));
+  expectDecoded(decoder, image, width, width, height);
+  EXPECT_EQ(buffer, decoder.depth());
+}
+
+TEST(RvlCodec, RejectsTruncatedData)
+{
+  const int width = 37, height = 13;
+  boost::mt19937 rng(3);
+  RvlEncoder encoder;
+  RvlDecoder decoder;
+  std::vector<uint8_t> data;
+  std::vector<uint16_t> image = randomImage(rng, width, width, height);
+  encoder.encode(&image[0], width, width, height, data);
+
+  // The last word always holds code, so every shorter stream is missing some
+  for (size_t size = 0; size < data.size(); ++size)
+  {
+    std::vector<uint8_t> truncated(data.begin(), data.begin() + size);
+    EXPECT_FALSE(decoder.decode(truncated)) << size << " of " << data.size() << " bytes";
+  }
+}
+
+TEST(RvlCodec, RejectsCorruptHeaders)
+{
+  const uint32_t headers[][2] = {{0, 480}, {640, 0}, {0xffffffff, 0xffffffff}, {1 << 13, 1 << 12},
+                                 {0x10000, 0x10001}};
+  RvlDecoder decoder;
+  for (size_t h = 0; h < sizeof(headers) / sizeof(headers[0]); ++h)
+  {
+    std::vector<uint8_t> data(64, 0);
+    memcpy(&data[0], headers[h], sizeof(headers[h]));
+    uint32_t width, height;
+    EXPECT_FALSE(RvlDecoder::peek(data, width, height)) << headers[h][0] << "x" << headers[h][1];
+    EXPECT_FALSE(decoder.decode(data));
+  }
+
+  // Zigzag deltas leaving 16 bits, or summing past the range of an int
+  const uint32_t deltas[][2] = {{0x20000, 0}, {1, 0}, {0x1fffe, 2}, {0xfffffffe, 0xfffffffe}};
+  for (size_t d = 0; d < sizeof(deltas) / sizeof(deltas[0]); ++d)
+  {
+    std::vector<uint32_t> values;
+    values.push_back(0);
+    values.push_back(2);
+    values.insert(values.end(), deltas[d], deltas[d] + 2);
+    EXPECT_FALSE(decoder.decode(codeStream(2, 1, values))) << deltas[d][0] << ", " << deltas[d][1];
+  }
+  const uint32_t extremes[] = {0, 2, 0x1fffe, 0x1fffd};
+  ASSERT_TRUE(decoder.decode(codeStream(2, 1, std::vector<uint32_t>(extremes, extremes + 4))));
+  EXPECT_EQ(0xffff, decoder.depth()[0]);
+  EXPECT_EQ(0, decoder.depth()[1]);
+
+  // Random code words must fail cleanly or decode to the header's size
+  boost::mt19937 rng(4);
+  boost::uniform_int<int> byte(0, 255);
+  for (int i = 0; i < 200; ++i)
+  {
+    const uint32_t header[2] = {8, 8};
+    std::vector<uint8_t> data(8 + 4 * (i % 40));
+    memcpy(&data[0], header, sizeof(header));
+    for (size_t b = 8; b < data.size(); ++b)
+      data[b] = byte(rng);
+    if (decoder.decode(data))
+    {
+      EXPECT_EQ(64u, decoder.width() * decoder.height());
+    }
+  }
+}